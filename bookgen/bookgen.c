@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "comms.h"
+#include "bitboard.h"
+#include "hash.h"
+#include "options.h"
+#include "search.h"
+#include "eval.h"
+#include "book.h"
+
+/*
+ * Grows an opening book by drop-out expansion. Every position in the book
+ * has a value: the engine's score at a fixed depth for a leaf, the negamax
+ * of its moves once it has been expanded. Each round expands the leaves
+ * that are cheapest to reach from the start, where every move on the way
+ * costs how much worse it is than the best move of its position plus
+ * DROP_OUT_PLY discs. So the book follows the best lines deepest and drops
+ * out of worse ones the further they fall behind. Expanding a leaf adds all
+ * its moves as new leaves. Their searches are handed out to the other
+ * ranks, which search one position at a time and send the score back.
+ * The book is written in the player's format every CHECKPOINT_SECONDS and at
+ * the end, and an existing book is grown further.
+ *
+ * mpirun -np <ranks> player/bookgen [search depth] [searches] [book file]
+ */
+#define DROP_OUT_PLY 2			/* cost of a ply, in discs */
+#define LEAVES_PER_RANK 4		/* leaves expanded per round for each searching rank */
+#define CHECKPOINT_SECONDS 60.0
+
+#define TAG_BOOK_JOB 21			/* rank 0 -> worker: {node, player, opponent} to search */
+#define TAG_BOOK_RESULT 22		/* worker -> rank 0: {node, score} */
+#define TAG_BOOK_STOP 23		/* rank 0 -> worker: no more positions */
+
+/* States of a node */
+#define LEAF 0				/* searched, moves not in the book */
+#define UNSEARCHED 1			/* just added, waiting for its search */
+#define EXPANDED 2			/* every move is in the book */
+
+typedef struct {
+	uint64_t key;
+	uint64_t player;		/* canonical position */
+	uint64_t opponent;
+	int value;			/* for the side to move, in search units; the book itself keeps whole discs */
+	int state;
+	int best_move;			/* in the canonical orientation, PASS for a leaf */
+	int first_child;		/* into children, once expanded */
+	int num_children;
+	int cost;			/* cheapest way from the start found this round */
+	int round;			/* round the cost and the value belong to */
+	int heap_index;
+} node_t;
+
+typedef struct {
+	int node;
+	int move;			/* in the canonical orientation of the parent */
+} child_t;
+
+static node_t *nodes = NULL;
+static long num_nodes = 0, node_capacity = 0;
+static child_t *children = NULL;
+static long num_children = 0, child_capacity = 0;
+
+/* Open addressing index from canonical key to node */
+static long *index_slots = NULL;
+static long index_capacity = 0;
+
+static int depth;
+static int round_number = 0;
+
+static void out_of_memory(void) {
+	fprintf(stderr, "bookgen: out of memory\n");
+	MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+static long find_node(uint64_t key, uint64_t player, uint64_t opponent) {
+	long slot = (long) (key & (uint64_t) (index_capacity - 1));
+
+	for (; index_slots[slot] >= 0; slot = (slot + 1) & (index_capacity - 1)) {
+		const node_t *node = &nodes[index_slots[slot]];
+		if (node->key == key && node->player == player && node->opponent == opponent) return index_slots[slot];
+	}
+	return -1;
+}
+
+static void index_node(long n) {
+	long slot = (long) (nodes[n].key & (uint64_t) (index_capacity - 1));
+
+	while (index_slots[slot] >= 0) slot = (slot + 1) & (index_capacity - 1);
+	index_slots[slot] = n;
+}
+
+/**
+ * Makes room for one more node, keeping the index at most half full
+ */
+static void grow(void) {
+	long n;
+
+	if (num_nodes == node_capacity) {
+		long capacity = node_capacity ? 2 * node_capacity : 65536;
+		node_t *grown = realloc(nodes, capacity * sizeof(node_t));
+
+		if (grown == NULL) out_of_memory();
+		nodes = grown;
+		node_capacity = capacity;
+	}
+	if (2 * (num_nodes + 1) > index_capacity) {
+		free(index_slots);
+		index_capacity = index_capacity ? 2 * index_capacity : 131072;
+		index_slots = malloc(index_capacity * sizeof(long));
+		if (index_slots == NULL) out_of_memory();
+		memset(index_slots, -1, index_capacity * sizeof(long));
+		for (n = 0; n < num_nodes; n++) index_node(n);
+	}
+}
+
+/**
+ * Returns the node of pos, adding it as an unsearched one if it is new
+ */
+static long node_of(const position_t *pos) {
+	position_t canonical;
+	long n;
+
+	grow();
+	bb_canonical(pos, &canonical);
+	n = find_node(canonical.key, canonical.player, canonical.opponent);
+	if (n >= 0) return n;
+
+	n = num_nodes++;
+	memset(&nodes[n], 0, sizeof(node_t));
+	nodes[n].key = canonical.key;
+	nodes[n].player = canonical.player;
+	nodes[n].opponent = canonical.opponent;
+	nodes[n].state = UNSEARCHED;
+	nodes[n].best_move = PASS;
+	nodes[n].round = -1;
+	index_node(n);
+	return n;
+}
+
+static void add_child(long node, int move) {
+	if (num_children == child_capacity) {
+		long capacity = child_capacity ? 2 * child_capacity : 262144;
+		child_t *grown = realloc(children, capacity * sizeof(child_t));
+
+		if (grown == NULL) out_of_memory();
+		children = grown;
+		child_capacity = capacity;
+	}
+	children[num_children].node = (int) node;
+	children[num_children].move = move;
+	num_children++;
+}
+
+/**
+ * Adds every move of node n to the book. A finished game needs no search
+ * and has no moves; a pass is a move to the same discs with the sides swapped
+ */
+static void expand(long n) {
+	position_t pos = {nodes[n].player, nodes[n].opponent, 0, 0};
+	uint64_t moves = bb_legal_moves(pos.player, pos.opponent);
+	long first = num_children;
+
+	if (moves == 0) {
+		position_t passed = {pos.opponent, pos.player, 0, 0};
+
+		if (bb_legal_moves(passed.player, passed.opponent) == 0) {
+			nodes[n].value = final_score(&pos);
+			nodes[n].state = EXPANDED;
+			nodes[n].first_child = (int) first;
+			nodes[n].num_children = 0;
+			return;
+		}
+		add_child(node_of(&passed), PASS);
+	}
+	for (; moves; moves &= moves - 1) {
+		int sq = bb_first_square(moves);
+		position_t child = pos;
+
+		bb_make_move(&child, sq, bb_flips(sq, child.player, child.opponent));
+		add_child(node_of(&child), sq);
+	}
+	/* node_of may have moved the nodes */
+	nodes[n].first_child = (int) first;
+	nodes[n].num_children = (int) (num_children - first);
+	nodes[n].state = EXPANDED;
+}
+
+/**
+ * Works out the negamax value and best move of every expanded node below n
+ */
+static int back_up(long n) {
+	node_t *node = &nodes[n];
+	int i;
+
+	if (node->state != EXPANDED || node->num_children == 0 || node->round == round_number) return node->value;
+	node->round = round_number;
+	node->value = -SCORE_INF;
+	for (i = 0; i < node->num_children; i++) {
+		const child_t *child = &children[node->first_child + i];
+		int value = -back_up(child->node);
+
+		if (value > nodes[n].value) {
+			nodes[n].value = value;
+			nodes[n].best_move = child->move;
+		}
+	}
+	return nodes[n].value;
+}
+
+/* Binary heap of nodes by cost, for picking the cheapest leaves */
+static long *heap = NULL;
+static long heap_size = 0;
+
+static void heap_swap(long i, long j) {
+	long t = heap[i];
+
+	heap[i] = heap[j];
+	heap[j] = t;
+	nodes[heap[i]].heap_index = (int) i;
+	nodes[heap[j]].heap_index = (int) j;
+}
+
+static void heap_up(long i) {
+	while (i > 0 && nodes[heap[(i - 1) / 2]].cost > nodes[heap[i]].cost) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static long heap_pop(void) {
+	long top = heap[0], i = 0;
+
+	heap_swap(0, --heap_size);
+	nodes[top].heap_index = -1;
+	for (;;) {
+		long smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < heap_size && nodes[heap[left]].cost < nodes[heap[smallest]].cost) smallest = left;
+		if (right < heap_size && nodes[heap[right]].cost < nodes[heap[smallest]].cost) smallest = right;
+		if (smallest == i) break;
+		heap_swap(i, smallest);
+		i = smallest;
+	}
+	return top;
+}
+
+/**
+ * Finds up to max_leaves leaves in order of their drop-out cost from the
+ * root (Dijkstra's algorithm, the costs never being negative) and writes
+ * them to leaves. Returns how many there are
+ */
+static int pick_leaves(long *leaves, int max_leaves) {
+	int found = 0, i;
+
+	heap = realloc(heap, num_nodes * sizeof(long));
+	if (heap == NULL) out_of_memory();
+	heap_size = 0;
+	round_number++;
+	nodes[0].cost = 0;
+	nodes[0].round = round_number;
+	nodes[0].heap_index = 0;
+	heap[heap_size++] = 0;
+
+	while (heap_size > 0 && found < max_leaves) {
+		long n = heap_pop();
+		node_t *node = &nodes[n];
+
+		if (node->state == LEAF) {
+			leaves[found++] = n;
+			continue;
+		}
+		for (i = 0; i < node->num_children; i++) {
+			const child_t *child = &children[node->first_child + i];
+			node_t *next = &nodes[child->node];
+			int cost = node->cost + (node->value + next->value) + DROP_OUT_PLY * SCORE_DISC;
+
+			if (next->round != round_number) {
+				next->round = round_number;
+				next->cost = cost;
+				next->heap_index = (int) heap_size;
+				heap[heap_size++] = child->node;
+				heap_up(heap_size - 1);
+			} else if (next->heap_index >= 0 && cost < next->cost) {
+				next->cost = cost;
+				heap_up(next->heap_index);
+			}
+		}
+	}
+	return found;
+}
+
+/**
+ * Searches the unsearched nodes from first on, on the other ranks if there
+ * are any. Returns how many searches there were
+ */
+static long search_new_nodes(long first, int comm_sz) {
+	long next = first, searched = 0;
+	int busy = 0, rank;
+
+	for (; next < num_nodes && nodes[next].state != UNSEARCHED; next++);
+	if (comm_sz == 1) {
+		for (; next < num_nodes; next++) {
+			position_t pos = {nodes[next].player, nodes[next].opponent, 0, 0};
+			int score;
+
+			if (nodes[next].state != UNSEARCHED) continue;
+			bb_hash_position(&pos);
+			start_search_clock(1e9);
+			search_local(&pos, depth, -SCORE_INF, SCORE_INF, &score);
+			nodes[next].value = score;
+			nodes[next].state = LEAF;
+			searched++;
+		}
+		return searched;
+	}
+
+	for (rank = 1; rank < comm_sz && next < num_nodes; rank++) {
+		int64_t job[3] = {next, (int64_t) nodes[next].player, (int64_t) nodes[next].opponent};
+
+		MPI_Send(job, 3, MPI_INT64_T, rank, TAG_BOOK_JOB, MPI_COMM_WORLD);
+		busy++;
+		for (next++; next < num_nodes && nodes[next].state != UNSEARCHED; next++);
+	}
+	while (busy > 0) {
+		int64_t result[2];
+		MPI_Status status;
+
+		MPI_Recv(result, 2, MPI_INT64_T, MPI_ANY_SOURCE, TAG_BOOK_RESULT, MPI_COMM_WORLD, &status);
+		nodes[result[0]].value = (int) result[1];
+		nodes[result[0]].state = LEAF;
+		searched++;
+		busy--;
+		if (next < num_nodes) {
+			int64_t job[3] = {next, (int64_t) nodes[next].player, (int64_t) nodes[next].opponent};
+
+			MPI_Send(job, 3, MPI_INT64_T, status.MPI_SOURCE, TAG_BOOK_JOB, MPI_COMM_WORLD);
+			busy++;
+			for (next++; next < num_nodes && nodes[next].state != UNSEARCHED; next++);
+		}
+	}
+	return searched;
+}
+
+/**
+ * Rounds a score to the nearest whole disc
+ */
+static int to_discs(int score) {
+	return (score >= 0) ? (score + SCORE_DISC / 2) / SCORE_DISC : -((SCORE_DISC / 2 - score) / SCORE_DISC);
+}
+
+/**
+ * Writes the book in the player's format
+ */
+static int checkpoint(const char *path) {
+	book_entry_t *entries = calloc(num_nodes, sizeof(book_entry_t));
+	long n;
+	int status;
+
+	if (entries == NULL) return FAILURE;
+	for (n = 0; n < num_nodes; n++) {
+		entries[n].key = nodes[n].key;
+		entries[n].player = nodes[n].player;
+		entries[n].opponent = nodes[n].opponent;
+		entries[n].score = (int16_t) to_discs(nodes[n].value);
+		entries[n].move = (int8_t) (nodes[n].state == EXPANDED ? nodes[n].best_move : PASS);
+		entries[n].depth = (int8_t) depth;
+		entries[n].flags = (nodes[n].state == EXPANDED) ? BOOK_EXPANDED : 0;
+	}
+	status = book_write(path, entries, num_nodes);
+	free(entries);
+	return status;
+}
+
+/**
+ * Reads back a book written by checkpoint and rebuilds the moves of its
+ * expanded positions. Returns how many positions there were
+ */
+static long resume(const char *path) {
+	book_file_header_t header;
+	book_entry_t entry;
+	long n, count = 0, loaded;
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) return 0;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != BOOK_FILE_MAGIC || header.version != BOOK_FILE_VERSION) {
+		fprintf(stderr, "%s is not a book, starting a new one\n", path);
+		fclose(file);
+		return 0;
+	}
+	for (; count < (long) header.count && fread(&entry, sizeof(entry), 1, file) == 1; count++) {
+		position_t pos = {entry.player, entry.opponent, 0, 0};
+
+		n = node_of(&pos);
+		nodes[n].value = entry.score * SCORE_DISC;
+		/* EXPANDED for now only marks the nodes whose moves are added below */
+		nodes[n].state = (entry.flags & BOOK_EXPANDED) ? EXPANDED : LEAF;
+	}
+	fclose(file);
+
+	loaded = num_nodes;
+	for (n = 0; n < loaded; n++) {
+		if (nodes[n].state == EXPANDED) expand(n);
+	}
+	return count;
+}
+
+static void run_worker(void) {
+	for (;;) {
+		int64_t job[3], result[2];
+		MPI_Status status;
+		position_t pos;
+		int score;
+
+		MPI_Recv(job, 3, MPI_INT64_T, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+		if (status.MPI_TAG == TAG_BOOK_STOP) return;
+		pos.player = (uint64_t) job[1];
+		pos.opponent = (uint64_t) job[2];
+		bb_hash_position(&pos);
+		start_search_clock(1e9);
+		search_local(&pos, depth, -SCORE_INF, SCORE_INF, &score);
+		result[0] = job[0];
+		result[1] = score;
+		MPI_Send(result, 2, MPI_INT64_T, 0, TAG_BOOK_RESULT, MPI_COMM_WORLD);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int rank, comm_sz, max_leaves, found, i;
+	long searches = 0, budget, resumed, first, expanded, n;
+	long *leaves;
+	const char *path;
+	position_t start;
+	double started, last_checkpoint;
+
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+	options_load();
+	options.threads = 1;
+	depth = (argc >= 2) ? atoi(argv[1]) : 10;
+	budget = (argc >= 3) ? atol(argv[2]) : 10000;
+	path = (argc >= 4) ? argv[3] : options.book;
+	if (depth < 1 || budget < 1) {
+		if (rank == 0) fprintf(stderr, "Arguments: [search depth] [searches] [book file]\n");
+		MPI_Finalize();
+		return 1;
+	}
+
+	bb_init_kernels();
+	bb_init_zobrist();
+	if (tt_init(options.hash_mb) == FAILURE || search_init() == FAILURE || eval_init(options.weights) == FAILURE) {
+		fprintf(stderr, "Could not allocate the tables\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (rank != 0) {
+		run_worker();
+		search_free();
+		tt_free();
+		eval_free();
+		MPI_Finalize();
+		return 0;
+	}
+
+	max_leaves = LEAVES_PER_RANK * ((comm_sz > 1) ? comm_sz - 1 : 1);
+	leaves = malloc(max_leaves * sizeof(long));
+	if (leaves == NULL) out_of_memory();
+
+	/* the start position is node 0, the root of the drop-out costs */
+	bb_init_position(&start);
+	node_of(&start);
+	resumed = resume(path);
+	printf("%d ranks, search depth %d, %ld positions from %s, %s weights\n", comm_sz, depth, resumed,
+		resumed ? path : "scratch", eval_weights_loaded ? options.weights : "built-in");
+	fflush(stdout);
+
+	started = last_checkpoint = MPI_Wtime();
+	searches += search_new_nodes(0, comm_sz);
+	while (searches < budget) {
+		round_number++;
+		back_up(0);
+		found = pick_leaves(leaves, max_leaves);
+		if (found == 0) break;
+		first = num_nodes;
+		for (i = 0; i < found; i++) expand(leaves[i]);
+		searches += search_new_nodes(first, comm_sz);
+
+		if (MPI_Wtime() - last_checkpoint >= CHECKPOINT_SECONDS || searches >= budget) {
+			round_number++;
+			back_up(0);
+			for (expanded = 0, n = 0; n < num_nodes; n++) expanded += (nodes[n].state == EXPANDED);
+			if (checkpoint(path) == FAILURE) fprintf(stderr, "Could not write %s\n", path);
+			printf("%ld positions, %ld expanded, %ld searches in %.1f s, start position %+.2f\n", num_nodes, expanded,
+				searches, MPI_Wtime() - started, score_in_discs(nodes[0].value));
+			fflush(stdout);
+			last_checkpoint = MPI_Wtime();
+		}
+	}
+	round_number++;
+	back_up(0);
+	if (checkpoint(path) == SUCCESS) {
+		printf("book written to %s\n", path);
+	} else {
+		fprintf(stderr, "Could not write %s\n", path);
+	}
+
+	for (i = 1; i < comm_sz; i++) MPI_Send(NULL, 0, MPI_INT64_T, i, TAG_BOOK_STOP, MPI_COMM_WORLD);
+	free(leaves);
+	free(heap);
+	free(index_slots);
+	free(children);
+	free(nodes);
+	search_free();
+	tt_free();
+	eval_free();
+	MPI_Finalize();
+	return 0;
+}
@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include "bitboard.h"
+
+/*
+ * Zobrist keys: zobrist[0] for discs of the side to move, zobrist[1] for
+ * the other side. Every position also carries the key it would have with
+ * the sides swapped, which is what lets the key follow the side to move
+ * through a move or a pass without rescanning the board.
+ */
+static uint64_t zobrist[2][NUM_SQUARES];
+static uint64_t zobrist_flip[NUM_SQUARES];
+
+/**
+ * Fills the Zobrist tables from a fixed seed, so every rank and every
+ * run agrees on the keys
+ */
+void bb_init_zobrist(void) {
+	uint64_t seed = 0x4F7468656C6C6F21ULL;
+	int side, sq;
+
+	for (side = 0; side < 2; side++) {
+		for (sq = 0; sq < NUM_SQUARES; sq++) {
+			/* splitmix64 */
+			uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			zobrist[side][sq] = z ^ (z >> 31);
+		}
+	}
+	for (sq = 0; sq < NUM_SQUARES; sq++) zobrist_flip[sq] = zobrist[0][sq] ^ zobrist[1][sq];
+}
+
+/**
+ * Computes the keys of pos from scratch
+ */
+void bb_hash_position(position_t *pos) {
+	uint64_t b;
+
+	pos->key = 0;
+	pos->mirror_key = 0;
+	for (b = pos->player; b; b &= b - 1) {
+		pos->key ^= zobrist[0][bb_first_square(b)];
+		pos->mirror_key ^= zobrist[1][bb_first_square(b)];
+	}
+	for (b = pos->opponent; b; b &= b - 1) {
+		pos->key ^= zobrist[1][bb_first_square(b)];
+		pos->mirror_key ^= zobrist[0][bb_first_square(b)];
+	}
+}
+
+/**
+ * Sets up the standard starting position with black to move
+ */
+void bb_init_position(position_t *pos) {
+	pos->player = SQUARE_BIT(SQUARE(3, 4)) | SQUARE_BIT(SQUARE(4, 3));
+	pos->opponent = SQUARE_BIT(SQUARE(3, 3)) | SQUARE_BIT(SQUARE(4, 4));
+	bb_hash_position(pos);
+}
+
+/**
+ * Returns the set of empty squares where player may move, found by sliding
+ * runs of opponent discs away from player's discs one direction at a time.
+ * Reference version of the kernels in bitboard_simd.c
+ */
+uint64_t bb_legal_moves_scalar(uint64_t player, uint64_t opponent) {
+	uint64_t empty = ~(player | opponent);
+	uint64_t inner = opponent & INNER_COLS;
+	uint64_t moves = 0;
+	uint64_t t;
+
+	/* horizontal */
+	t = inner & (player << 1);
+	t |= inner & (t << 1); t |= inner & (t << 1); t |= inner & (t << 1);
+	t |= inner & (t << 1); t |= inner & (t << 1);
+	moves |= empty & (t << 1);
+	t = inner & (player >> 1);
+	t |= inner & (t >> 1); t |= inner & (t >> 1); t |= inner & (t >> 1);
+	t |= inner & (t >> 1); t |= inner & (t >> 1);
+	moves |= empty & (t >> 1);
+
+	/* vertical */
+	t = opponent & (player << 8);
+	t |= opponent & (t << 8); t |= opponent & (t << 8); t |= opponent & (t << 8);
+	t |= opponent & (t << 8); t |= opponent & (t << 8);
+	moves |= empty & (t << 8);
+	t = opponent & (player >> 8);
+	t |= opponent & (t >> 8); t |= opponent & (t >> 8); t |= opponent & (t >> 8);
+	t |= opponent & (t >> 8); t |= opponent & (t >> 8);
+	moves |= empty & (t >> 8);
+
+	/* diagonals */
+	t = inner & (player << 7);
+	t |= inner & (t << 7); t |= inner & (t << 7); t |= inner & (t << 7);
+	t |= inner & (t << 7); t |= inner & (t << 7);
+	moves |= empty & (t << 7);
+	t = inner & (player >> 7);
+	t |= inner & (t >> 7); t |= inner & (t >> 7); t |= inner & (t >> 7);
+	t |= inner & (t >> 7); t |= inner & (t >> 7);
+	moves |= empty & (t >> 7);
+	t = inner & (player << 9);
+	t |= inner & (t << 9); t |= inner & (t << 9); t |= inner & (t << 9);
+	t |= inner & (t << 9); t |= inner & (t << 9);
+	moves |= empty & (t << 9);
+	t = inner & (player >> 9);
+	t |= inner & (t >> 9); t |= inner & (t >> 9); t |= inner & (t >> 9);
+	t |= inner & (t >> 9); t |= inner & (t >> 9);
+	moves |= empty & (t >> 9);
+
+	return moves;
+}
+
+/**
+ * Walks from sq in one direction while the squares hold opponent discs.
+ * Returns the run if it is closed off by one of player's discs, else 0
+ */
+static uint64_t flips_in_direction(uint64_t start, int shift, uint64_t wrap_mask, uint64_t player, uint64_t opponent) {
+	uint64_t run = 0;
+	uint64_t x = start;
+
+	for (;;) {
+		x = (shift > 0) ? (x << shift) : (x >> -shift);
+		x &= wrap_mask;
+		if (!(x & opponent)) break;
+		run |= x;
+	}
+	return (x & player) ? run : 0;
+}
+
+/**
+ * Returns the discs that flip when player moves on sq.
+ * Reference version of the kernels in bitboard_simd.c
+ */
+uint64_t bb_flips_scalar(int sq, uint64_t player, uint64_t opponent) {
+	uint64_t m = SQUARE_BIT(sq);
+	uint64_t flips = 0;
+
+	flips |= flips_in_direction(m, 1, NOT_COL_A, player, opponent);
+	flips |= flips_in_direction(m, -1, NOT_COL_H, player, opponent);
+	flips |= flips_in_direction(m, 8, ~0ULL, player, opponent);
+	flips |= flips_in_direction(m, -8, ~0ULL, player, opponent);
+	flips |= flips_in_direction(m, 7, NOT_COL_H, player, opponent);
+	flips |= flips_in_direction(m, -7, NOT_COL_A, player, opponent);
+	flips |= flips_in_direction(m, 9, NOT_COL_A, player, opponent);
+	flips |= flips_in_direction(m, -9, NOT_COL_H, player, opponent);
+	return flips;
+}
+
+/**
+ * Places a disc for the side to move, flips the given discs and hands the
+ * move over to the other side. The keys are updated from the flipped discs only
+ */
+void bb_make_move(position_t *pos, int sq, uint64_t flips) {
+	uint64_t player = pos->player | flips | SQUARE_BIT(sq);
+	uint64_t key = pos->key;
+	uint64_t changed = 0;
+	uint64_t f;
+
+	for (f = flips; f; f &= f - 1) changed ^= zobrist_flip[bb_first_square(f)];
+
+	pos->player = pos->opponent & ~flips;
+	pos->opponent = player;
+	pos->key = pos->mirror_key ^ changed ^ zobrist[1][sq];
+	pos->mirror_key = key ^ changed ^ zobrist[0][sq];
+}
+
+/**
+ * Hands the move over to the other side without placing a disc
+ */
+void bb_pass(position_t *pos) {
+	uint64_t player = pos->player;
+	uint64_t key = pos->key;
+	pos->player = pos->opponent;
+	pos->opponent = player;
+	pos->key = pos->mirror_key;
+	pos->mirror_key = key;
+}
+
+/**
+ * bb_make_move that also fills in an undo record for bb_undo_move
+ */
+void bb_do_move(position_t *pos, int sq, uint64_t flips, undo_t *undo) {
+	undo->sq = sq;
+	undo->flips = flips;
+	undo->key = pos->key;
+	undo->mirror_key = pos->mirror_key;
+	bb_make_move(pos, sq, flips);
+}
+
+/**
+ * bb_pass that also fills in an undo record for bb_undo_move
+ */
+void bb_do_pass(position_t *pos, undo_t *undo) {
+	undo->sq = PASS;
+	undo->flips = 0;
+	undo->key = pos->key;
+	undo->mirror_key = pos->mirror_key;
+	bb_pass(pos);
+}
+
+/**
+ * Takes back the move recorded in undo, restoring pos in place
+ */
+void bb_undo_move(position_t *pos, const undo_t *undo) {
+	uint64_t player = pos->opponent;
+
+	if (undo->sq == PASS) {
+		pos->opponent = pos->player;
+	} else {
+		player &= ~(undo->flips | SQUARE_BIT(undo->sq));
+		pos->opponent = pos->player | undo->flips;
+	}
+	pos->player = player;
+	pos->key = undo->key;
+	pos->mirror_key = undo->mirror_key;
+}
+
+/**
+ * Writes the squares in the set to list in ascending order and returns how many there are
+ */
+int bb_to_list(uint64_t squares, int *list) {
+	int n = 0;
+	while (squares) {
+		list[n++] = bb_first_square(squares);
+		squares &= squares - 1;
+	}
+	return n;
+}
+
+/**
+ * Returns the squares on a line in direction shift (1, 7, 8 or 9) that
+ * also holds one of the given squares
+ */
+static uint64_t spread_along(uint64_t squares, int shift, uint64_t up_mask, uint64_t down_mask) {
+	int i;
+
+	for (i = 0; i < 7; i++) squares |= ((squares << shift) & up_mask) | ((squares >> shift) & down_mask);
+	return squares;
+}
+
+/**
+ * Returns a subset of discs that can never be flipped again: a disc is
+ * stable if along each of the four lines through it the line is full, or
+ * it borders the edge or a stable disc of its own colour
+ */
+uint64_t bb_stable_discs(uint64_t discs, uint64_t occupied) {
+	uint64_t empty = ~occupied;
+	uint64_t border = 0xFF818181818181FFULL;
+	uint64_t horizontal = ~spread_along(empty, 1, NOT_COL_A, NOT_COL_H) | ~INNER_COLS;
+	uint64_t vertical = ~spread_along(empty, 8, ~0ULL, ~0ULL) | 0xFF000000000000FFULL;
+	uint64_t diagonal = ~spread_along(empty, 9, NOT_COL_A, NOT_COL_H) | border;
+	uint64_t anti_diagonal = ~spread_along(empty, 7, NOT_COL_H, NOT_COL_A) | border;
+	uint64_t stable = 0, previous;
+
+	do {
+		previous = stable;
+		stable = discs
+			& (horizontal | ((stable << 1) & NOT_COL_A) | ((stable >> 1) & NOT_COL_H))
+			& (vertical | (stable << 8) | (stable >> 8))
+			& (diagonal | ((stable << 9) & NOT_COL_A) | ((stable >> 9) & NOT_COL_H))
+			& (anti_diagonal | ((stable << 7) & NOT_COL_H) | ((stable >> 7) & NOT_COL_A));
+	} while (stable != previous);
+	return stable;
+}
+
+/**
+ * Returns the image of sq under symmetry t of the board: bit 0 of t mirrors
+ * the columns, bit 1 the rows, and bit 2 then swaps rows and columns
+ */
+int bb_symmetry_square(int sq, int t) {
+	int row = sq / 8, col = sq % 8, swap;
+
+	if (t & 1) col = 7 - col;
+	if (t & 2) row = 7 - row;
+	if (t & 4) {
+		swap = row;
+		row = col;
+		col = swap;
+	}
+	return SQUARE(row, col);
+}
+
+/**
+ * Returns the image of a set of squares under symmetry t, as bb_symmetry_square
+ */
+uint64_t bb_symmetry(uint64_t b, int t) {
+	uint64_t x;
+
+	if (t & 1) {
+		b = ((b >> 1) & 0x5555555555555555ULL) | ((b & 0x5555555555555555ULL) << 1);
+		b = ((b >> 2) & 0x3333333333333333ULL) | ((b & 0x3333333333333333ULL) << 2);
+		b = ((b >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((b & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	}
+	if (t & 2) b = __builtin_bswap64(b);
+	if (t & 4) {
+		x = 0x0F0F0F0F00000000ULL & (b ^ (b << 28));
+		b ^= x ^ (x >> 28);
+		x = 0x3333000033330000ULL & (b ^ (b << 14));
+		b ^= x ^ (x >> 14);
+		x = 0x5500550055005500ULL & (b ^ (b << 7));
+		b ^= x ^ (x >> 7);
+	}
+	return b;
+}
+
+/**
+ * Writes the representative of pos among its 8 symmetric images to
+ * canonical, keys included, and returns the symmetry that leads to it
+ */
+int bb_canonical(const position_t *pos, position_t *canonical) {
+	int t, best = 0;
+
+	canonical->player = pos->player;
+	canonical->opponent = pos->opponent;
+	for (t = 1; t < 8; t++) {
+		uint64_t player = bb_symmetry(pos->player, t);
+		uint64_t opponent = bb_symmetry(pos->opponent, t);
+
+		if (player < canonical->player || (player == canonical->player && opponent < canonical->opponent)) {
+			canonical->player = player;
+			canonical->opponent = opponent;
+			best = t;
+		}
+	}
+	bb_hash_position(canonical);
+	return best;
+}
+
+void get_move_string(int loc, char *ms) {
+	ms[0] = loc / 8 + '0';
+	ms[1] = loc % 8 + '0';
+	ms[2] = '\n';
+	ms[3] = 0;
+}
+
+int get_loc(char *movestring) {
+	int row, col;
+	/* movestring of form "xy", x = row and y = column */
+	row = movestring[0] - '0';
+	col = movestring[1] - '0';
+	return SQUARE(row, col);
+}
@@ -0,0 +1,72 @@
+#ifndef _BITBOARD_H
+#define _BITBOARD_H
+
+#include <stdint.h>
+
+#define PASS -1
+#define NUM_SQUARES 64
+
+/*
+ * Square numbering: bit (row * 8 + col), row and col 0-based from the
+ * top left corner, i.e. the same order as the referee's "rc" move strings.
+ */
+#define SQUARE(row, col) ((row) * 8 + (col))
+#define SQUARE_BIT(sq) (1ULL << (sq))
+
+/* Masks that stop a shifted board from wrapping around to the next row */
+#define NOT_COL_A 0xFEFEFEFEFEFEFEFEULL
+#define NOT_COL_H 0x7F7F7F7F7F7F7F7FULL
+#define INNER_COLS 0x7E7E7E7E7E7E7E7EULL
+
+/* A position is seen from the side to move */
+typedef struct {
+	uint64_t player;	/* discs of the side to move */
+	uint64_t opponent;	/* discs of the side that just moved */
+	uint64_t key;		/* Zobrist key of player/opponent */
+	uint64_t mirror_key;	/* key of the same discs with the sides swapped */
+} position_t;
+
+/* What it takes to take a move (or a pass) back on the same position */
+typedef struct {
+	uint64_t flips;
+	uint64_t key;
+	uint64_t mirror_key;
+	int sq;			/* square played, or PASS */
+} undo_t;
+
+/* Move generation kernels, pointed at the fastest version the CPU supports by bb_init_kernels */
+extern uint64_t (*bb_legal_moves)(uint64_t player, uint64_t opponent);
+extern uint64_t (*bb_flips)(int sq, uint64_t player, uint64_t opponent);
+
+void bb_init_kernels(void);
+const char *bb_kernel_name(void);
+uint64_t bb_legal_moves_scalar(uint64_t player, uint64_t opponent);
+uint64_t bb_flips_scalar(int sq, uint64_t player, uint64_t opponent);
+
+void bb_init_zobrist(void);
+void bb_hash_position(position_t *pos);
+void bb_init_position(position_t *pos);
+void bb_make_move(position_t *pos, int sq, uint64_t flips);
+void bb_pass(position_t *pos);
+void bb_do_move(position_t *pos, int sq, uint64_t flips, undo_t *undo);
+void bb_do_pass(position_t *pos, undo_t *undo);
+void bb_undo_move(position_t *pos, const undo_t *undo);
+int bb_to_list(uint64_t squares, int *list);
+uint64_t bb_stable_discs(uint64_t discs, uint64_t occupied);
+int bb_symmetry_square(int sq, int t);
+uint64_t bb_symmetry(uint64_t b, int t);
+int bb_canonical(const position_t *pos, position_t *canonical);
+
+static inline int bb_count(uint64_t discs) {
+	return __builtin_popcountll(discs);
+}
+
+/* Returns the lowest numbered square in the set; the set must not be empty */
+static inline int bb_first_square(uint64_t squares) {
+	return __builtin_ctzll(squares);
+}
+
+int get_loc(char *movestring);
+void get_move_string(int loc, char *ms);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bitboard.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+uint64_t (*bb_legal_moves)(uint64_t player, uint64_t opponent) = bb_legal_moves_scalar;
+uint64_t (*bb_flips)(int sq, uint64_t player, uint64_t opponent) = bb_flips_scalar;
+
+static const char *kernel_name = "scalar";
+
+#ifdef HAVE_X86_KERNELS
+
+/*
+ * SSE2 kernels
+ * ------------
+ * Each vector holds a board and its vertical mirror (bswap), so one left
+ * shift by 7, 8 or 9 covers a direction and its upward twin at once.
+ * The two horizontal directions are left to scalar code.
+ */
+
+static inline uint64_t horizontal_moves(uint64_t player, uint64_t opponent) {
+	uint64_t inner = opponent & INNER_COLS;
+	uint64_t l, r;
+
+	l = inner & (player << 1);
+	l |= inner & (l << 1); l |= inner & (l << 1); l |= inner & (l << 1);
+	l |= inner & (l << 1); l |= inner & (l << 1);
+	r = inner & (player >> 1);
+	r |= inner & (r >> 1); r |= inner & (r >> 1); r |= inner & (r >> 1);
+	r |= inner & (r >> 1); r |= inner & (r >> 1);
+	return (l << 1) | (r >> 1);
+}
+
+static inline uint64_t horizontal_flips(uint64_t m, uint64_t player, uint64_t opponent) {
+	uint64_t inner = opponent & INNER_COLS;
+	uint64_t flips = 0;
+	uint64_t t;
+
+	t = inner & (m << 1);
+	t |= inner & (t << 1); t |= inner & (t << 1); t |= inner & (t << 1);
+	t |= inner & (t << 1); t |= inner & (t << 1);
+	if ((t << 1) & player) flips |= t;
+	t = inner & (m >> 1);
+	t |= inner & (t >> 1); t |= inner & (t >> 1); t |= inner & (t >> 1);
+	t |= inner & (t >> 1); t |= inner & (t >> 1);
+	if ((t >> 1) & player) flips |= t;
+	return flips;
+}
+
+#define FILL_SSE2(t, seed, o, s) \
+	t = _mm_and_si128(o, _mm_slli_epi64(seed, s)); \
+	t = _mm_or_si128(t, _mm_and_si128(o, _mm_slli_epi64(t, s))); \
+	t = _mm_or_si128(t, _mm_and_si128(o, _mm_slli_epi64(t, s))); \
+	t = _mm_or_si128(t, _mm_and_si128(o, _mm_slli_epi64(t, s))); \
+	t = _mm_or_si128(t, _mm_and_si128(o, _mm_slli_epi64(t, s))); \
+	t = _mm_or_si128(t, _mm_and_si128(o, _mm_slli_epi64(t, s)))
+
+/**
+ * Folds a [board, mirrored board] vector back into one board
+ */
+static inline uint64_t unmirror_sse2(__m128i v) {
+	uint64_t lo = (uint64_t) _mm_cvtsi128_si64(v);
+	uint64_t hi = (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+	return lo | __builtin_bswap64(hi);
+}
+
+static uint64_t legal_moves_sse2(uint64_t player, uint64_t opponent) {
+	__m128i pp = _mm_set_epi64x((long long) __builtin_bswap64(player), (long long) player);
+	__m128i oo = _mm_set_epi64x((long long) __builtin_bswap64(opponent), (long long) opponent);
+	__m128i inner = _mm_and_si128(oo, _mm_set1_epi64x((long long) INNER_COLS));
+	__m128i moves, t;
+
+	FILL_SSE2(t, pp, oo, 8);
+	moves = _mm_slli_epi64(t, 8);
+	FILL_SSE2(t, pp, inner, 7);
+	moves = _mm_or_si128(moves, _mm_slli_epi64(t, 7));
+	FILL_SSE2(t, pp, inner, 9);
+	moves = _mm_or_si128(moves, _mm_slli_epi64(t, 9));
+
+	return (unmirror_sse2(moves) | horizontal_moves(player, opponent)) & ~(player | opponent);
+}
+
+/**
+ * Keeps the runs in t whose next square along the shift holds one of player's discs.
+ * SSE2 has no 64-bit compare, so the lane test is built from two 32-bit halves
+ */
+#define BRACKETED_SSE2(t, pp, s) \
+	_mm_andnot_si128(zero_lanes_sse2(_mm_and_si128(_mm_slli_epi64(t, s), pp)), t)
+
+static inline __m128i zero_lanes_sse2(__m128i v) {
+	__m128i z = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+	return _mm_and_si128(z, _mm_shuffle_epi32(z, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static uint64_t flips_sse2(int sq, uint64_t player, uint64_t opponent) {
+	uint64_t m = SQUARE_BIT(sq);
+	__m128i mm = _mm_set_epi64x((long long) __builtin_bswap64(m), (long long) m);
+	__m128i pp = _mm_set_epi64x((long long) __builtin_bswap64(player), (long long) player);
+	__m128i oo = _mm_set_epi64x((long long) __builtin_bswap64(opponent), (long long) opponent);
+	__m128i inner = _mm_and_si128(oo, _mm_set1_epi64x((long long) INNER_COLS));
+	__m128i flips, t;
+
+	FILL_SSE2(t, mm, oo, 8);
+	flips = BRACKETED_SSE2(t, pp, 8);
+	FILL_SSE2(t, mm, inner, 7);
+	flips = _mm_or_si128(flips, BRACKETED_SSE2(t, pp, 7));
+	FILL_SSE2(t, mm, inner, 9);
+	flips = _mm_or_si128(flips, BRACKETED_SSE2(t, pp, 9));
+
+	return unmirror_sse2(flips) | horizontal_flips(m, player, opponent);
+}
+
+/*
+ * AVX2 kernels
+ * ------------
+ * The four lanes run the shifts 1, 8, 9 and 7 side by side with variable
+ * per-lane shift counts; one pass left and one pass right covers all 8 directions.
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define FILL_AVX2(t, seed, o, shift, op) \
+	t = _mm256_and_si256(o, op(seed, shift)); \
+	t = _mm256_or_si256(t, _mm256_and_si256(o, op(t, shift))); \
+	t = _mm256_or_si256(t, _mm256_and_si256(o, op(t, shift))); \
+	t = _mm256_or_si256(t, _mm256_and_si256(o, op(t, shift))); \
+	t = _mm256_or_si256(t, _mm256_and_si256(o, op(t, shift))); \
+	t = _mm256_or_si256(t, _mm256_and_si256(o, op(t, shift)))
+
+static inline AVX2 uint64_t or_lanes_avx2(__m256i v) {
+	__m128i x = _mm_or_si128(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	x = _mm_or_si128(x, _mm_unpackhi_epi64(x, x));
+	return (uint64_t) _mm_cvtsi128_si64(x);
+}
+
+static AVX2 uint64_t legal_moves_avx2(uint64_t player, uint64_t opponent) {
+	const __m256i shift = _mm256_set_epi64x(7, 9, 8, 1);
+	const __m256i mask = _mm256_set_epi64x((long long) INNER_COLS, (long long) INNER_COLS, -1LL, (long long) INNER_COLS);
+	__m256i pp = _mm256_set1_epi64x((long long) player);
+	__m256i oo = _mm256_and_si256(_mm256_set1_epi64x((long long) opponent), mask);
+	__m256i l, r;
+
+	FILL_AVX2(l, pp, oo, shift, _mm256_sllv_epi64);
+	FILL_AVX2(r, pp, oo, shift, _mm256_srlv_epi64);
+
+	return or_lanes_avx2(_mm256_or_si256(_mm256_sllv_epi64(l, shift), _mm256_srlv_epi64(r, shift)))
+		& ~(player | opponent);
+}
+
+static AVX2 uint64_t flips_avx2(int sq, uint64_t player, uint64_t opponent) {
+	const __m256i shift = _mm256_set_epi64x(7, 9, 8, 1);
+	const __m256i mask = _mm256_set_epi64x((long long) INNER_COLS, (long long) INNER_COLS, -1LL, (long long) INNER_COLS);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i mm = _mm256_set1_epi64x((long long) SQUARE_BIT(sq));
+	__m256i pp = _mm256_set1_epi64x((long long) player);
+	__m256i oo = _mm256_and_si256(_mm256_set1_epi64x((long long) opponent), mask);
+	__m256i l, r, open_l, open_r;
+
+	FILL_AVX2(l, mm, oo, shift, _mm256_sllv_epi64);
+	FILL_AVX2(r, mm, oo, shift, _mm256_srlv_epi64);
+
+	/* a run flips only if the square after it holds one of player's discs */
+	open_l = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_sllv_epi64(l, shift), pp), zero);
+	open_r = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_srlv_epi64(r, shift), pp), zero);
+
+	return or_lanes_avx2(_mm256_or_si256(_mm256_andnot_si256(open_l, l), _mm256_andnot_si256(open_r, r)));
+}
+
+#endif
+
+/**
+ * Points bb_legal_moves and bb_flips at the fastest kernels this CPU supports
+ * (checked through CPUID). OTHELLO_KERNEL=scalar|sse2|avx2 forces a choice,
+ * which is how the vector kernels are validated against the scalar reference.
+ */
+void bb_init_kernels(void) {
+	const char *forced = getenv("OTHELLO_KERNEL");
+
+	bb_legal_moves = bb_legal_moves_scalar;
+	bb_flips = bb_flips_scalar;
+	kernel_name = "scalar";
+	if (forced != NULL && strcmp(forced, "scalar") == 0) return;
+
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	bb_legal_moves = legal_moves_sse2;
+	bb_flips = flips_sse2;
+	kernel_name = "sse2";
+	if (forced != NULL && strcmp(forced, "sse2") == 0) return;
+
+	if (__builtin_cpu_supports("avx2")) {
+		bb_legal_moves = legal_moves_avx2;
+		bb_flips = flips_avx2;
+		kernel_name = "avx2";
+	}
+#endif
+}
+
+const char *bb_kernel_name(void) {
+	return kernel_name;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "comms.h"
+#include "book.h"
+
+/*
+ * The book is mapped read-only rather than read in, so it costs nothing
+ * until a position is looked up and every process on the host that maps
+ * it shares the same pages.
+ */
+static const book_entry_t *entries = NULL;
+static void *mapping = NULL;
+static size_t mapping_size = 0;
+long book_size = 0;
+
+/**
+ * Maps the book file at path; without it the book is empty
+ */
+int book_open(const char *path) {
+	book_file_header_t header;
+	struct stat info;
+	int fd;
+
+	book_close();
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return FAILURE;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(header)) {
+		close(fd);
+		return FAILURE;
+	}
+	mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		mapping = NULL;
+		return FAILURE;
+	}
+	mapping_size = info.st_size;
+
+	memcpy(&header, mapping, sizeof(header));
+	if (header.magic != BOOK_FILE_MAGIC || header.version != BOOK_FILE_VERSION
+			|| mapping_size != sizeof(header) + header.count * sizeof(book_entry_t)) {
+		book_close();
+		return FAILURE;
+	}
+	entries = (const book_entry_t *) ((const char *) mapping + sizeof(header));
+	book_size = (long) header.count;
+	return SUCCESS;
+}
+
+void book_close(void) {
+	if (mapping != NULL) munmap(mapping, mapping_size);
+	mapping = NULL;
+	entries = NULL;
+	book_size = 0;
+}
+
+/**
+ * Returns the entry of pos, or NULL if it is not in the book; symmetry
+ * receives the symmetry that takes pos to the stored orientation
+ */
+const book_entry_t *book_find(const position_t *pos, int *symmetry) {
+	position_t canonical;
+	long low = 0, high = book_size - 1;
+
+	*symmetry = bb_canonical(pos, &canonical);
+	while (low <= high) {
+		long middle = (low + high) / 2;
+		const book_entry_t *entry = &entries[middle];
+
+		if (entry->key < canonical.key) {
+			low = middle + 1;
+		} else if (entry->key > canonical.key) {
+			high = middle - 1;
+		} else {
+			return (entry->player == canonical.player && entry->opponent == canonical.opponent) ? entry : NULL;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns the book move for pos and its score, or PASS if the book has no
+ * move for it. Only positions whose moves were expanded in the book count
+ */
+int book_move(const position_t *pos, int *score) {
+	const book_entry_t *entry;
+	uint64_t moves = bb_legal_moves(pos->player, pos->opponent);
+	int symmetry;
+
+	if (book_size == 0 || moves == 0) return PASS;
+	entry = book_find(pos, &symmetry);
+	if (entry == NULL || !(entry->flags & BOOK_EXPANDED) || entry->move == PASS) return PASS;
+	/* the move in the orientation of pos is the one the symmetry takes to the stored move */
+	for (; moves; moves &= moves - 1) {
+		int sq = bb_first_square(moves);
+
+		if (bb_symmetry_square(sq, symmetry) == entry->move) {
+			*score = entry->score;
+			return sq;
+		}
+	}
+	return PASS;
+}
+
+static int compare_keys(const void *a, const void *b) {
+	uint64_t x = ((const book_entry_t *) a)->key, y = ((const book_entry_t *) b)->key;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Sorts the entries by key and writes them as a book file. The file is
+ * written under a temporary name and renamed, so a book being read or a
+ * checkpoint interrupted halfway never leaves a broken file at path
+ */
+int book_write(const char *path, book_entry_t *book, long count) {
+	book_file_header_t header = {BOOK_FILE_MAGIC, BOOK_FILE_VERSION, (uint64_t) count};
+	char temporary[4096];
+	FILE *file;
+	int status;
+
+	if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int) sizeof(temporary)) return FAILURE;
+	qsort(book, count, sizeof(book_entry_t), compare_keys);
+	file = fopen(temporary, "wb");
+	if (file == NULL) return FAILURE;
+	status = (fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(book, sizeof(book_entry_t), count, file) == (size_t) count)
+		? SUCCESS : FAILURE;
+	if (fclose(file) != 0) status = FAILURE;
+	if (status == SUCCESS && rename(temporary, path) != 0) status = FAILURE;
+	if (status == FAILURE) remove(temporary);
+	return status;
+}
@@ -0,0 +1,41 @@
+#ifndef _BOOK_H
+#define _BOOK_H
+
+#include <stdint.h>
+#include "bitboard.h"
+
+/*
+ * Opening book file: this header, then count entries sorted by key. A
+ * position is stored once for all its symmetric images, as the canonical
+ * one of bb_canonical, and its move is in that orientation too.
+ */
+#define BOOK_FILE_MAGIC 0x4248544FU	/* "OTHB" */
+#define BOOK_FILE_VERSION 1
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;
+} book_file_header_t;
+
+#define BOOK_EXPANDED 1			/* the moves of the position are in the book as well */
+
+typedef struct {
+	uint64_t key;			/* Zobrist key of the canonical position */
+	uint64_t player;		/* the canonical position */
+	uint64_t opponent;
+	int16_t score;			/* minimax value for the side to move, in discs */
+	int8_t move;			/* best move, or PASS */
+	int8_t depth;			/* depth of the searches at the leaves below */
+	uint8_t flags;
+	uint8_t pad[3];
+} book_entry_t;
+
+extern long book_size;
+
+int book_open(const char *path);
+void book_close(void);
+const book_entry_t *book_find(const position_t *pos, int *symmetry);
+int book_move(const position_t *pos, int *score);
+int book_write(const char *path, book_entry_t *entries, long count);
+
+#endif
@@ -1,22 +1,43 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "comms.h" 
 
-const int LENBUFSIZE=3;
-const int MSGBUFSIZE=100;
+/*
+ * The referee sends its colour as one byte, then messages framed by a
+ * two-digit decimal length. TCP may split a frame over several reads or
+ * deliver several frames in one, so everything read goes into a static
+ * buffer first and frames are taken from there, in place.
+ */
+#define LENGTH_DIGITS 2
+#define INBOX_SIZE 256		/* more than the largest frame, 2 + 99 bytes */
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL	/* a closed connection fails the send instead of raising SIGPIPE */
+#else
+#define SEND_FLAGS 0
+#endif
 
 int comms_get_colour(int* my_colour);
 
 static int socket_desc;
+static char inbox[INBOX_SIZE];
+static int inbox_start = 0;	/* first byte not yet taken */
+static int inbox_end = 0;	/* end of the bytes read */
 
 /**
  * Creates socket, connects to remote server, and calls comms_get_colour 
  */
 int comms_init_network(int* my_colour, unsigned long ip, int port) {
 	struct sockaddr_in server;
+	int no_delay = 1;
 
 	/* Create socket */
 	socket_desc = socket(AF_INET, SOCK_STREAM, 0);
@@ -39,82 +60,175 @@ int comms_init_network(int* my_colour, unsigned long ip, int port) {
 		return FAILURE;
 	}
 
+	/* Moves are a few bytes each and should leave at once rather than wait to be coalesced */
+	setsockopt(socket_desc, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	inbox_start = inbox_end = 0;
+
 	return comms_get_colour(my_colour);
 }
 
 /**
- * Creates socket, connects to remote server, and calls comms_get_colour 
+ * Milliseconds left until deadline, for poll; -1 waits for ever
+ */
+static int time_left(const struct timespec *deadline) {
+	struct timespec now;
+	long ms;
+
+	if (deadline == NULL) return -1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+	return (ms > 0) ? (int) ms : 0;
+}
+
+/**
+ * Waits until the inbox holds at least count bytes past inbox_start, reading
+ * as much as the socket has each time. Returns SUCCESS, COMMS_TIMEOUT if the
+ * deadline (NULL for none) passed first, with what was read kept for the
+ * next call, or FAILURE if the connection failed or closed
+ */
+static int fill_inbox(int count, const struct timespec *deadline) {
+	while (inbox_end - inbox_start < count) {
+		struct pollfd ready = {socket_desc, POLLIN, 0};
+		ssize_t received;
+		int status;
+
+		/* what is left of a frame moves to the front to make room */
+		if (INBOX_SIZE - inbox_start < count) {
+			memmove(inbox, inbox + inbox_start, inbox_end - inbox_start);
+			inbox_end -= inbox_start;
+			inbox_start = 0;
+		}
+
+		status = poll(&ready, 1, time_left(deadline));
+		if (status < 0 && errno == EINTR) continue;
+		if (status < 0) return FAILURE;
+		if (status == 0) return COMMS_TIMEOUT;
+
+		received = recv(socket_desc, inbox + inbox_end, INBOX_SIZE - inbox_end, 0);
+		if (received < 0 && errno == EINTR) continue;
+		if (received <= 0) {
+			#ifdef DEBUG
+			printf("Comms error: Connection to the referee lost\n");
+			#endif
+			return FAILURE;
+		}
+		inbox_end += (int) received;
+	}
+	return SUCCESS;
+}
+
+/**
+ * Takes the next frame from the inbox, reading more if needed. On SUCCESS
+ * payload points at the frame's bytes in the inbox, valid until the next
+ * read, and length is their number
+ */
+static int next_frame(const char **payload, int *length, const struct timespec *deadline) {
+	int status, i;
+
+	status = fill_inbox(LENGTH_DIGITS, deadline);
+	if (status != SUCCESS) return status;
+	*length = 0;
+	for (i = 0; i < LENGTH_DIGITS; i++) {
+		char digit = inbox[inbox_start + i];
+
+		if (digit < '0' || digit > '9') {
+			#ifdef DEBUG
+			printf("Comms error: Bad message length\n");
+			#endif
+			return FAILURE;
+		}
+		*length = *length * 10 + (digit - '0');
+	}
+
+	status = fill_inbox(LENGTH_DIGITS + *length, deadline);
+	if (status != SUCCESS) return status;
+	*payload = inbox + inbox_start + LENGTH_DIGITS;
+	inbox_start += LENGTH_DIGITS + *length;
+	if (inbox_start == inbox_end) inbox_start = inbox_end = 0;
+	return SUCCESS;
+}
+
+/**
+ * Copies the length bytes at text into buffer of the given size, cut short if need be, and terminates them
+ */
+static void copy_word(char *buffer, int size, const char *text, int length) {
+	if (length > size - 1) length = size - 1;
+	memcpy(buffer, text, length);
+	buffer[length] = '\0';
+}
+
+/**
+ * Receives the colour, the single byte the referee sends before any message
  */
 int comms_get_colour(int* my_colour) {
-	char tempColour[2]; tempColour[1] = 0;
-	if(recv(socket_desc, tempColour , 1, 0) < 0){
+	if (fill_inbox(1, NULL) != SUCCESS) {
 		#ifdef DEBUG
 		printf("Comms error: Could not receive colour\n");
 		#endif
 		return FAILURE;
 	}
-	*my_colour = atoi(tempColour);
+	*my_colour = inbox[inbox_start++] - '0';
 	return SUCCESS;
 }
 
 /**
  * Receives message from server, which includes a cmd 
- * and, if cmd == play_move, also the opponent's move 
+ * and, if cmd == play_move, also the opponent's move.
+ * Waits at most timeout_ms milliseconds, or for ever if it is negative;
+ * returns COMMS_TIMEOUT if no whole message came in by then
  */
-int comms_get_cmd(char cmd[], char move[]) {
-	int result = SUCCESS;
-	int msg_len;
-
-	char* tmp_cmd;
-	char* tmp_move;
-
-	char* len_buf = malloc(LENBUFSIZE*sizeof(char));
-	char* msg_buf = malloc(MSGBUFSIZE*sizeof(char)); 
-
-	memset(len_buf, 0, LENBUFSIZE);
-	memset(msg_buf, 0, MSGBUFSIZE);
-
-	if (recv(socket_desc, len_buf , 2, 0) < 0){
-		result = FAILURE;
-	} else {
-
-		msg_len = atoi(len_buf);
-	
-		if (recv(socket_desc, msg_buf, msg_len, 0) < 0){
-			result = FAILURE; 
-		} else {
-
-			msg_buf[msg_len] = '\0';
-
-			//strok is a dangerous command: 
-			//- modifies argument
-			//- returns a ptr into argument 
-			//- maintains state, which is not thread-state  
-			tmp_cmd = strtok(msg_buf, " ");  //get ptr to cmd in msg_buf; 
-			tmp_move = strtok(NULL, " ");	//get ptr to move in msg_buf
-
-			strncpy(cmd, tmp_cmd, CMDBUFSIZE); 
-			if (tmp_move != NULL) strncpy(move, tmp_move, MOVEBUFSIZE);
-
-			result = SUCCESS;
+int comms_wait_cmd(char cmd[], char move[], int timeout_ms) {
+	struct timespec deadline;
+	const char *payload;
+	const char *space;
+	int length, status;
+
+	if (timeout_ms >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
 		}
 	}
+	status = next_frame(&payload, &length, (timeout_ms >= 0) ? &deadline : NULL);
+	if (status != SUCCESS) return status;
+
+	/* the command runs up to the first space, the move from there to the next one */
+	space = memchr(payload, ' ', length);
+	copy_word(cmd, CMDBUFSIZE, payload, (space != NULL) ? (int) (space - payload) : length);
+	if (space != NULL) {
+		const char *word = space + 1;
+		const char *end = payload + length;
+		const char *next = memchr(word, ' ', end - word);
+
+		copy_word(move, MOVEBUFSIZE, word, (int) (((next != NULL) ? next : end) - word));
+	}
+	return SUCCESS;
+}
 
-	free(len_buf);
-	free(msg_buf);
-
-	return result;
+/**
+ * Receives message from server, waiting as long as it takes
+ */
+int comms_get_cmd(char cmd[], char move[]) {
+	return comms_wait_cmd(cmd, move, -1);
 }
 
 /**
- * Sends a message to the server, which includes my_move 
- * and, if cmd == play_move, also the opponent's move 
+ * Sends a message to the server, which includes my_move.
+ * A send may take only part of the message, so it goes on until all of it is out
  */
 int comms_send_move(char my_move[]) {
+	size_t length = strlen(my_move);
+	size_t sent = 0;
 
-	if (send(socket_desc, my_move, strlen(my_move) , 0) < 0) {
-		return FAILURE;
-	}
+	while (sent < length) {
+		ssize_t count = send(socket_desc, my_move + sent, length - sent, SEND_FLAGS);
 
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return FAILURE;
+		sent += (size_t) count;
+	}
 	return SUCCESS;
 }
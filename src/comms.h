@@ -3,6 +3,7 @@
 
 #define FAILURE -1
 #define SUCCESS 0
+#define COMMS_TIMEOUT 1
 
 #define MOVEBUFSIZE 6
 #define CMDBUFSIZE 100
@@ -10,6 +11,7 @@
 int comms_init(int* my_colour);
 int comms_init_network(int* my_colour, unsigned long ip, int port);
 int comms_get_cmd(char cmd[], char move[]);
+int comms_wait_cmd(char cmd[], char move[], int timeout_ms);
 int comms_send_move(char move[]);
 
 #endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "comms.h"
+#include "hash.h"
+#include "dtt.h"
+
+/*
+ * Distributed transposition table
+ * -------------------------------
+ * A second table, partitioned by key over all ranks and reached with MPI
+ * one-sided communication, so a rank can use what another rank has
+ * already searched. Every rank exposes its partition in an RMA window
+ * that stays open (lock_all) for the whole game. Probes fetch a bucket
+ * with MPI_Get_accumulate(MPI_NO_OP); stores write an entry with
+ * MPI_Accumulate(MPI_REPLACE). Both are atomic per word, and a rank goes
+ * through the window for its own partition too, so the accesses never
+ * conflict. Entries use the same key ^ data check as the local table, so
+ * a torn entry reads as a miss and no locks are needed.
+ * A store is blind: it does not read the bucket first, which would cost a
+ * round trip per store, and always goes to the slot picked by a key bit.
+ * The local table stays in front as the cache: hits from here are copied
+ * into it. Only the main thread of a rank calls this.
+ */
+
+int dtt_enabled = 0;
+
+static MPI_Win window;
+static tt_words_t *partition = NULL;
+static uint64_t bucket_mask = 0;
+static int num_ranks;
+
+/**
+ * Allocates this rank's partition of (at most) the given size in megabytes
+ * and opens the window. Collective; every rank must pass the same size.
+ * A size of 0, or a single rank, leaves the table switched off
+ */
+int dtt_init(int megabytes) {
+	uint64_t bytes = (uint64_t) megabytes << 20;
+	uint64_t buckets = 1;
+
+	MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+	if (megabytes <= 0 || num_ranks < 2) return SUCCESS;
+
+	while (buckets * 2 * TT_BUCKET_SIZE * sizeof(tt_words_t) <= bytes) buckets *= 2;
+	if (MPI_Win_allocate(buckets * TT_BUCKET_SIZE * sizeof(tt_words_t), sizeof(tt_words_t), MPI_INFO_NULL,
+			MPI_COMM_WORLD, &partition, &window) != MPI_SUCCESS) {
+		return FAILURE;
+	}
+	bucket_mask = buckets - 1;
+	memset(partition, 0, buckets * TT_BUCKET_SIZE * sizeof(tt_words_t));
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+	/* nobody may write into a partition before its owner has cleared it, and the window has seen it */
+	MPI_Win_sync(window);
+	MPI_Barrier(MPI_COMM_WORLD);
+	dtt_enabled = 1;
+	return SUCCESS;
+}
+
+/**
+ * Closes the window. Collective
+ */
+void dtt_free(void) {
+	if (!dtt_enabled) return;
+	MPI_Win_unlock_all(window);
+	MPI_Win_free(&window);
+	partition = NULL;
+	dtt_enabled = 0;
+}
+
+/**
+ * Finds the rank that holds key and the offset of its bucket there. The
+ * bits from 20 up number a bucket among those of all ranks together: the
+ * remainder by the number of ranks is the owner and the quotient the
+ * bucket there, so the two never share bits, however large the partitions.
+ * Bit 19 picks the slot a store goes to (see dtt_store); the bottom bits
+ * already index the local table
+ */
+static int locate(uint64_t key, MPI_Aint *disp) {
+	uint64_t bits = key >> 20;
+
+	*disp = (MPI_Aint) (((bits / (uint64_t) num_ranks) & bucket_mask) * TT_BUCKET_SIZE);
+	return (int) (bits % (uint64_t) num_ranks);
+}
+
+/**
+ * Copies the entry stored for key into entry and returns 1, or returns 0 on a miss
+ */
+int dtt_probe(uint64_t key, tt_entry_t *entry) {
+	tt_words_t bucket[TT_BUCKET_SIZE];
+	MPI_Aint disp;
+	int rank = locate(key, &disp);
+
+	MPI_Get_accumulate(NULL, 0, MPI_UINT64_T, bucket, 2 * TT_BUCKET_SIZE, MPI_UINT64_T,
+			rank, disp, 2 * TT_BUCKET_SIZE, MPI_UINT64_T, MPI_NO_OP, window);
+	MPI_Win_flush(rank, window);
+	return tt_read_bucket(bucket, key, entry);
+}
+
+/**
+ * Writes the entry for key without waiting for the owner. A key always
+ * lands in the same slot of its bucket, so a deeper search of a position
+ * replaces the shallower one instead of sitting beside it
+ */
+void dtt_store(uint64_t key, int depth, int score, int bound, int move) {
+	tt_words_t words = tt_pack(key, depth, score, bound, move);
+	MPI_Aint disp;
+	int rank = locate(key, &disp);
+
+	disp += (MPI_Aint) ((key >> 19) & (TT_BUCKET_SIZE - 1));
+	MPI_Accumulate(&words, 2, MPI_UINT64_T, rank, disp, 2, MPI_UINT64_T, MPI_REPLACE, window);
+	MPI_Win_flush_local(rank, window);
+}
@@ -0,0 +1,18 @@
+#ifndef _DTT_H
+#define _DTT_H
+
+#include <stdint.h>
+#include "hash.h"
+#include "options.h"
+
+/* Remote probes cost a round trip, so only nodes with this much depth left use the distributed table */
+#define dtt_worth(depth) (dtt_enabled && (depth) >= options.dtt_depth)
+
+extern int dtt_enabled;
+
+int dtt_init(int megabytes);
+void dtt_free(void);
+int dtt_probe(uint64_t key, tt_entry_t *entry);
+void dtt_store(uint64_t key, int depth, int score, int bound, int move);
+
+#endif
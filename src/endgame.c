@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <mpi.h>
+#include "comms.h"
+#include "bitboard.h"
+#include "search.h"
+#include "endgame.h"
+
+/*
+ * The last plies of the game, searched to the end on plain bitboards. Moves
+ * are tried fastest first, the ones that leave the opponent the fewest
+ * replies, while that is worth working out; among equals, and near the end
+ * on their own, moves into a quadrant with an odd number of empty squares
+ * go first, since whoever fills a region last usually gains from it.
+ */
+#define FASTEST_FIRST_EMPTIES 7		/* fewer empties than this: parity order only */
+#define STABILITY_EMPTIES 6		/* fewer empties than this: no stability cutoffs */
+
+static const uint64_t quadrants[4] = {
+	0x000000000F0F0F0FULL, 0x00000000F0F0F0F0ULL, 0x0F0F0F0F00000000ULL, 0xF0F0F0F000000000ULL
+};
+
+/**
+ * Returns the squares of the quadrants that hold an odd number of the empty squares
+ */
+uint64_t endgame_odd_regions(uint64_t empty) {
+	uint64_t odd = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (bb_count(empty & quadrants[i]) & 1) odd |= quadrants[i];
+	}
+	return odd;
+}
+
+/**
+ * Returns the best final score the side to move can still hope for, in
+ * discs: the opponent's stable discs are lost to it for good
+ */
+int endgame_stability_bound(uint64_t player, uint64_t opponent) {
+	return NUM_SQUARES - 2 * bb_count(bb_stable_discs(opponent, player | opponent));
+}
+
+/*
+ * The last four empty squares have kernels of their own: they try the empty
+ * squares directly, a square being a legal move when it flips something,
+ * without generating moves or keeping a move list, and the last move is
+ * only counted, never made. Most of the nodes of a deep solve are here.
+ */
+int endgame_kernels = 1;
+
+/**
+ * Returns the final score when sq is the last empty square
+ */
+static int solve_1(uint64_t player, uint64_t opponent, int sq, search_stats_t *stats) {
+	/* the disc difference if the square stays empty */
+	int score = 2 * bb_count(player) - (NUM_SQUARES - 1);
+	int flipped = bb_count(bb_flips(sq, player, opponent));
+
+	stats->leaves++;
+	if (flipped > 0) {
+		stats->nodes++;
+		return score + 2 * flipped + 1;
+	}
+	flipped = bb_count(bb_flips(sq, opponent, player));
+	if (flipped > 0) {
+		stats->nodes += 2;
+		return score - 2 * flipped - 1;
+	}
+	return score;
+}
+
+static int solve_2(uint64_t player, uint64_t opponent, int alpha, int beta, int sq1, int sq2, int passed, search_stats_t *stats) {
+	uint64_t flips;
+	int score, best = -SCORE_INF;
+
+	if ((flips = bb_flips(sq1, player, opponent)) != 0) {
+		stats->nodes++;
+		best = -solve_1(opponent & ~flips, player | flips | SQUARE_BIT(sq1), sq2, stats);
+		if (best >= beta) return best;
+	}
+	if ((flips = bb_flips(sq2, player, opponent)) != 0) {
+		stats->nodes++;
+		score = -solve_1(opponent & ~flips, player | flips | SQUARE_BIT(sq2), sq1, stats);
+		if (score > best) best = score;
+	}
+	if (best > -SCORE_INF) return best;
+	if (passed) {
+		stats->leaves++;
+		return bb_count(player) - bb_count(opponent);
+	}
+	stats->nodes++;
+	return -solve_2(opponent, player, -beta, -alpha, sq1, sq2, 1, stats);
+}
+
+static int solve_3(uint64_t player, uint64_t opponent, int alpha, int beta, const int *sq, int passed, search_stats_t *stats) {
+	uint64_t flips;
+	int i, score, best = -SCORE_INF;
+
+	for (i = 0; i < 3; i++) {
+		if ((flips = bb_flips(sq[i], player, opponent)) == 0) continue;
+		stats->nodes++;
+		score = -solve_2(opponent & ~flips, player | flips | SQUARE_BIT(sq[i]), -beta, -alpha,
+			sq[i == 0 ? 1 : 0], sq[i == 2 ? 1 : 2], 0, stats);
+		if (score > best) {
+			best = score;
+			if (score > alpha) alpha = score;
+			if (alpha >= beta) return best;
+		}
+	}
+	if (best > -SCORE_INF) return best;
+	if (passed) {
+		stats->leaves++;
+		return bb_count(player) - bb_count(opponent);
+	}
+	stats->nodes++;
+	return -solve_3(opponent, player, -beta, -alpha, sq, 1, stats);
+}
+
+static int solve_4(uint64_t player, uint64_t opponent, int alpha, int beta, const int *sq, int passed, search_stats_t *stats) {
+	uint64_t flips;
+	int rest[3];
+	int i, j, k, score, best = -SCORE_INF;
+
+	for (i = 0; i < 4; i++) {
+		if ((flips = bb_flips(sq[i], player, opponent)) == 0) continue;
+		for (j = 0, k = 0; j < 4; j++) {
+			if (j != i) rest[k++] = sq[j];
+		}
+		stats->nodes++;
+		score = -solve_3(opponent & ~flips, player | flips | SQUARE_BIT(sq[i]), -beta, -alpha, rest, 0, stats);
+		if (score > best) {
+			best = score;
+			if (score > alpha) alpha = score;
+			if (alpha >= beta) return best;
+		}
+	}
+	if (best > -SCORE_INF) return best;
+	if (passed) {
+		stats->leaves++;
+		return bb_count(player) - bb_count(opponent);
+	}
+	stats->nodes++;
+	return -solve_4(opponent, player, -beta, -alpha, sq, 1, stats);
+}
+
+/**
+ * Hands a position with one to four empty squares to its kernel, the
+ * squares in odd quadrants first
+ */
+static int solve_last(uint64_t player, uint64_t opponent, int alpha, int beta, int passed, search_stats_t *stats) {
+	uint64_t empty = ~(player | opponent);
+	uint64_t odd = endgame_odd_regions(empty);
+	int sq[4];
+	int n;
+
+	n = bb_to_list(empty & odd, sq);
+	n += bb_to_list(empty & ~odd, sq + n);
+	switch (n) {
+	case 1: return solve_1(player, opponent, sq[0], stats);
+	case 2: return solve_2(player, opponent, alpha, beta, sq[0], sq[1], passed, stats);
+	case 3: return solve_3(player, opponent, alpha, beta, sq, passed, stats);
+	default: return solve_4(player, opponent, alpha, beta, sq, passed, stats);
+	}
+}
+
+/**
+ * Fail-soft alpha-beta to the end of the game; passed tells that the other
+ * side has just passed. Every position is counted by its parent
+ */
+static int solve(uint64_t player, uint64_t opponent, int alpha, int beta, int passed, search_stats_t *stats) {
+	uint64_t empty = ~(player | opponent);
+	int empties = bb_count(empty);
+	int squares[MAX_MOVES], keys[MAX_MOVES];
+	uint64_t moves, odd;
+	int n = 0, i, j, score, best = -SCORE_INF;
+
+	if (endgame_kernels && empties > 0 && empties <= 4) return solve_last(player, opponent, alpha, beta, passed, stats);
+	moves = (empties > 0) ? bb_legal_moves(player, opponent) : 0;
+	if (moves == 0) {
+		if (passed || empties == 0 || bb_legal_moves(opponent, player) == 0) {
+			stats->leaves++;
+			return bb_count(player) - bb_count(opponent);
+		}
+		stats->nodes++;
+		return -solve(opponent, player, -beta, -alpha, 1, stats);
+	}
+	if (empties >= STABILITY_EMPTIES) {
+		score = endgame_stability_bound(player, opponent);
+		if (score <= alpha) {
+			stats->stability_cutoffs++;
+			return score;
+		}
+	}
+
+	odd = endgame_odd_regions(empty);
+	for (; moves; moves &= moves - 1) {
+		int sq = bb_first_square(moves);
+		int key = (SQUARE_BIT(sq) & odd) ? 1 : 0;
+
+		if (empties >= FASTEST_FIRST_EMPTIES) {
+			uint64_t flips = bb_flips(sq, player, opponent);
+			key -= 2 * bb_count(bb_legal_moves(opponent & ~flips, player | flips | SQUARE_BIT(sq)));
+		}
+		for (j = n++; j > 0 && keys[j - 1] < key; j--) {
+			keys[j] = keys[j - 1];
+			squares[j] = squares[j - 1];
+		}
+		keys[j] = key;
+		squares[j] = sq;
+	}
+
+	for (i = 0; i < n; i++) {
+		uint64_t flips = bb_flips(squares[i], player, opponent);
+
+		stats->nodes++;
+		score = -solve(opponent & ~flips, player | flips | SQUARE_BIT(squares[i]), -beta, -alpha, 0, stats);
+		if (score > best) {
+			best = score;
+			if (score > alpha) alpha = score;
+			if (alpha >= beta) {
+				stats->cutoffs++;
+				if (i == 0) stats->first_cutoffs++;
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+/**
+ * Returns the final score of the position for the side to move if it lies
+ * within (alpha, beta), or a bound on it otherwise. Nodes are counted in
+ * stats; the position itself has been counted by the caller.
+ * The solver counts whole discs: the window is widened to the nearest
+ * ones, which leaves the same final scores inside it, and the score is
+ * handed back in the search's units
+ */
+int endgame_solve(uint64_t player, uint64_t opponent, int alpha, int beta, search_stats_t *stats) {
+	int lower = (alpha >= 0) ? alpha / SCORE_DISC : -((SCORE_DISC - 1 - alpha) / SCORE_DISC);
+	int upper = (beta >= 0) ? (beta + SCORE_DISC - 1) / SCORE_DISC : -(-beta / SCORE_DISC);
+
+	return solve(player, opponent, lower, upper, 0, stats) * SCORE_DISC;
+}
+
+/**
+ * Plays random moves from the starting position until empties squares are
+ * left. Returns 0 if the game ended first
+ */
+static int random_position(position_t *pos, int empties, uint64_t *seed) {
+	bb_init_position(pos);
+	while (NUM_SQUARES - bb_count(pos->player | pos->opponent) > empties) {
+		uint64_t moves = bb_legal_moves(pos->player, pos->opponent);
+		int skip;
+
+		if (moves == 0) {
+			if (bb_legal_moves(pos->opponent, pos->player) == 0) return 0;
+			bb_pass(pos);
+			continue;
+		}
+		/* xorshift64 */
+		*seed ^= *seed << 13;
+		*seed ^= *seed >> 7;
+		*seed ^= *seed << 17;
+		for (skip = (int) (*seed % (uint64_t) bb_count(moves)); skip > 0; skip--) moves &= moves - 1;
+		bb_make_move(pos, bb_first_square(moves), bb_flips(bb_first_square(moves), pos->player, pos->opponent));
+	}
+	return 1;
+}
+
+/**
+ * Solves this rank's share of the positions, dealt out round robin, and
+ * returns the time the slowest rank took. Scores go to scores[i], nodes are
+ * summed over the ranks into *nodes at rank 0
+ */
+static double solve_suite(const position_t *suite, int count, int *scores, long *nodes) {
+	search_stats_t stats = {0};
+	int rank, comm_sz, i;
+	double start, elapsed, slowest;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+	MPI_Barrier(MPI_COMM_WORLD);
+	start = MPI_Wtime();
+	for (i = rank; i < count; i += comm_sz) {
+		scores[i] = solve(suite[i].player, suite[i].opponent, -SCORE_INF, SCORE_INF, 0, &stats);
+	}
+	elapsed = MPI_Wtime() - start;
+	MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&stats.nodes, nodes, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	return slowest;
+}
+
+/**
+ * --endgame <empties> [positions]
+ * Solves a fixed suite of positions (20 by default) with that many empty
+ * squares, reached by random play from the start with the same seed every
+ * run, once along the general path and once with the last four empties in
+ * their kernels, and reports both node rates. The positions are dealt out
+ * round robin over the MPI ranks.
+ */
+int run_endgame(int argc, char *argv[]) {
+	int rank, empties, count, i, n, mismatches = 0;
+	uint64_t seed = 0x656E6467616D6521ULL;
+	position_t *suite;
+	int *general, *kernels;
+	long general_nodes = 0, kernel_nodes = 0;
+	double general_time, kernel_time;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	empties = (argc >= 3) ? atoi(argv[2]) : 0;
+	count = (argc >= 4) ? atoi(argv[3]) : 20;
+	if (empties < 1 || empties > NUM_SQUARES - 4 || count < 1) {
+		if (rank == 0) fprintf(stderr, "Arguments: --endgame <empties> [positions]\n");
+		return FAILURE;
+	}
+
+	suite = malloc(count * sizeof(position_t));
+	general = calloc(count, sizeof(int));
+	kernels = calloc(count, sizeof(int));
+	if (suite == NULL || general == NULL || kernels == NULL) {
+		free(suite);
+		free(general);
+		free(kernels);
+		return FAILURE;
+	}
+	for (n = 0; n < count; ) {
+		if (random_position(&suite[n], empties, &seed)) n++;
+	}
+
+	endgame_kernels = 0;
+	general_time = solve_suite(suite, count, general, &general_nodes);
+	endgame_kernels = 1;
+	kernel_time = solve_suite(suite, count, kernels, &kernel_nodes);
+
+	/* every rank has the scores of its own positions only */
+	for (i = 0; i < count; i++) {
+		if (general[i] != kernels[i]) mismatches++;
+	}
+	MPI_Allreduce(MPI_IN_PLACE, &mismatches, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+	if (rank == 0) {
+		printf("endgame: %d positions with %d empties (%s kernels)\n", count, empties, bb_kernel_name());
+		printf("  general path: %ld nodes in %.3f s, %.0f nodes/s\n", general_nodes, general_time,
+			general_time > 0 ? general_nodes / general_time : 0.0);
+		printf("  last 4 empties in kernels: %ld nodes in %.3f s, %.0f nodes/s, %.2fx as fast\n", kernel_nodes, kernel_time,
+			kernel_time > 0 ? kernel_nodes / kernel_time : 0.0, kernel_time > 0 ? general_time / kernel_time : 0.0);
+		printf("  %d scores differ\n", mismatches);
+		fflush(stdout);
+	}
+	free(suite);
+	free(general);
+	free(kernels);
+	return (mismatches == 0) ? SUCCESS : FAILURE;
+}
@@ -0,0 +1,17 @@
+#ifndef _ENDGAME_H
+#define _ENDGAME_H
+
+#include <stdint.h>
+#include "search.h"
+
+/* Positions this close to the end are solved by endgame_solve alone, without the transposition table, the clock or the other ranks */
+#define ENDGAME_LOCAL_EMPTIES 10
+
+extern int endgame_kernels;
+
+uint64_t endgame_odd_regions(uint64_t empty);
+int endgame_stability_bound(uint64_t player, uint64_t opponent);
+int endgame_solve(uint64_t player, uint64_t opponent, int alpha, int beta, search_stats_t *stats);
+int run_endgame(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <mpi.h>
+#include "comms.h"
+#include "eval.h"
+
+/* A pattern in one orientation, squares numbered as in bitboard.h; the first square is the most significant base-3 digit */
+typedef struct {
+	int size;
+	int squares[EVAL_MAX_PATTERN];
+} pattern_t;
+
+static const pattern_t patterns[] = {
+	{10, {0, 1, 2, 3, 4, 5, 6, 7, 9, 14}},		/* edge and both X squares */
+	{9, {0, 1, 2, 8, 9, 10, 16, 17, 18}},		/* corner 3x3 */
+	{10, {0, 1, 2, 3, 4, 8, 9, 10, 11, 12}},	/* corner 2x5 */
+	{8, {8, 9, 10, 11, 12, 13, 14, 15}},		/* second row */
+	{8, {16, 17, 18, 19, 20, 21, 22, 23}},		/* third row */
+	{8, {24, 25, 26, 27, 28, 29, 30, 31}},		/* fourth row */
+	{8, {0, 9, 18, 27, 36, 45, 54, 63}},		/* main diagonal */
+	{7, {1, 10, 19, 28, 37, 46, 55}},		/* diagonals of 7 to 4 squares */
+	{6, {2, 11, 20, 29, 38, 47}},
+	{5, {3, 12, 21, 30, 39}},
+	{4, {4, 13, 22, 31}},
+};
+#define NUM_PATTERNS ((int) (sizeof(patterns) / sizeof(patterns[0])))
+
+/* One copy of a pattern on the board, and where its table starts in a phase's weights */
+typedef struct {
+	int size;
+	int squares[EVAL_MAX_PATTERN];
+	int offset;
+} instance_t;
+
+static instance_t instances[EVAL_INSTANCES];
+static int num_instances = 0;
+
+/* For every square, the instances it is part of and the value of its digit in each; a pattern crossing a square more often needs a larger bound */
+#define MAX_SQUARE_INSTANCES 8
+typedef struct {
+	int count;
+	int instance[MAX_SQUARE_INSTANCES];
+	int digit[MAX_SQUARE_INSTANCES];
+} square_instances_t;
+
+static square_instances_t square_instances[NUM_SQUARES];
+
+int eval_table_size = 0;
+int eval_weights_loaded = 0;
+static int16_t *weights = NULL;
+
+/*
+ * Weights used when there is no weight file: every square is worth a fixed
+ * amount to whoever holds it, shared out between the patterns that cover
+ * it. Corners are good and the squares next to them bad early on, and by
+ * the end of the game every disc counts the same.
+ */
+static const int square_values[NUM_SQUARES] = {
+	 6, -2,  1,  1,  1,  1, -2,  6,
+	-2, -4,  0,  0,  0,  0, -4, -2,
+	 1,  0,  0,  0,  0,  0,  0,  1,
+	 1,  0,  0,  0,  0,  0,  0,  1,
+	 1,  0,  0,  0,  0,  0,  0,  1,
+	 1,  0,  0,  0,  0,  0,  0,  1,
+	-2, -4,  0,  0,  0,  0, -4, -2,
+	 6, -2,  1,  1,  1,  1, -2,  6,
+};
+
+static int power_of_3(int n) {
+	int p = 1;
+
+	while (n-- > 0) p *= 3;
+	return p;
+}
+
+/**
+ * Lays the patterns out on the board in every orientation that covers a
+ * different set of squares
+ */
+static void build_instances(void) {
+	uint64_t masks[EVAL_INSTANCES];
+	int p, t, i, offset = 0;
+
+	num_instances = 0;
+	for (p = 0; p < NUM_PATTERNS; p++) {
+		int first = num_instances;
+
+		for (t = 0; t < 8; t++) {
+			instance_t instance;
+			uint64_t mask = 0;
+
+			for (i = 0; i < patterns[p].size; i++) {
+				instance.squares[i] = bb_symmetry_square(patterns[p].squares[i], t);
+				mask |= SQUARE_BIT(instance.squares[i]);
+			}
+			for (i = first; i < num_instances && masks[i] != mask; i++);
+			if (i < num_instances || num_instances == EVAL_INSTANCES) continue;
+			instance.size = patterns[p].size;
+			instance.offset = offset;
+			instances[num_instances] = instance;
+			masks[num_instances++] = mask;
+		}
+		offset += power_of_3(patterns[p].size);
+	}
+	eval_table_size = offset;
+
+	memset(square_instances, 0, sizeof(square_instances));
+	for (i = 0; i < num_instances; i++) {
+		for (t = 0; t < instances[i].size; t++) {
+			square_instances_t *on = &square_instances[instances[i].squares[t]];
+
+			assert(on->count < MAX_SQUARE_INSTANCES);
+			on->instance[on->count] = i;
+			on->digit[on->count++] = power_of_3(instances[i].size - 1 - t);
+		}
+	}
+}
+
+/**
+ * Fills the weights from square_values
+ */
+static void default_weights(void) {
+	int coverage[NUM_SQUARES] = {0};
+	int phase, p, i, index, j;
+
+	for (i = 0; i < num_instances; i++) {
+		for (j = 0; j < instances[i].size; j++) coverage[instances[i].squares[j]]++;
+	}
+	for (phase = 0; phase < EVAL_PHASES; phase++) {
+		int16_t *table = weights + (size_t) phase * eval_table_size;
+
+		for (p = 0; p < NUM_PATTERNS; p++) {
+			int size = patterns[p].size;
+
+			for (index = 0; index < power_of_3(size); index++) {
+				int digits = index, value = 0;
+
+				/* the last square is the least significant digit */
+				for (j = size - 1; j >= 0; j--, digits /= 3) {
+					int sq = patterns[p].squares[j];
+					int worth = (square_values[sq] * (EVAL_PHASES - 1 - phase) + phase) * EVAL_SCALE
+						/ ((EVAL_PHASES - 1) * coverage[sq]);
+
+					if (digits % 3 == 1) value += worth;
+					else if (digits % 3 == 2) value -= worth;
+				}
+				*table++ = (int16_t) value;
+			}
+		}
+	}
+}
+
+/**
+ * Reads the weights from a weight file written by eval_save
+ */
+static int load_weights(const char *path) {
+	eval_file_header_t header;
+	size_t count = (size_t) EVAL_PHASES * eval_table_size;
+	FILE *file = fopen(path, "rb");
+	int status = FAILURE;
+
+	if (file == NULL) return FAILURE;
+	if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == EVAL_FILE_MAGIC && header.version == EVAL_FILE_VERSION
+			&& header.phases == EVAL_PHASES && header.table_size == (uint32_t) eval_table_size && header.scale == EVAL_SCALE
+			&& fread(weights, sizeof(int16_t), count, file) == count) {
+		status = SUCCESS;
+	}
+	fclose(file);
+	return status;
+}
+
+/**
+ * Sets up the patterns and the weights: rank 0 reads the weight file at
+ * path and hands it to the others, or all of them fall back to built-in
+ * weights if it is missing or does not fit. Collective over all ranks
+ */
+int eval_init(const char *path) {
+	int rank;
+
+	build_instances();
+	free(weights);
+	weights = malloc((size_t) EVAL_PHASES * eval_table_size * sizeof(int16_t));
+	if (weights == NULL) return FAILURE;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	if (rank == 0) eval_weights_loaded = (path != NULL && load_weights(path) == SUCCESS);
+	MPI_Bcast(&eval_weights_loaded, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	if (eval_weights_loaded) {
+		MPI_Bcast(weights, EVAL_PHASES * eval_table_size, MPI_INT16_T, 0, MPI_COMM_WORLD);
+	} else {
+		default_weights();
+	}
+	return SUCCESS;
+}
+
+void eval_free(void) {
+	free(weights);
+	weights = NULL;
+}
+
+/**
+ * Writes a weight file of EVAL_PHASES tables of eval_table_size weights
+ */
+int eval_save(const char *path, const int16_t *table) {
+	eval_file_header_t header = {EVAL_FILE_MAGIC, EVAL_FILE_VERSION, EVAL_PHASES, (uint32_t) eval_table_size, EVAL_SCALE};
+	size_t count = (size_t) EVAL_PHASES * eval_table_size;
+	FILE *file = fopen(path, "wb");
+	int status;
+
+	if (file == NULL) return FAILURE;
+	status = (fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(table, sizeof(int16_t), count, file) == count) ? SUCCESS : FAILURE;
+	if (fclose(file) != 0) status = FAILURE;
+	return status;
+}
+
+/**
+ * Returns the weights in use, EVAL_PHASES tables of eval_table_size
+ */
+const int16_t *eval_weights(void) {
+	return weights;
+}
+
+/**
+ * Returns the stage of the game with this many discs on the board, from 0 to EVAL_PHASES - 1
+ */
+static int phase_of(int discs) {
+	return (discs - 4) * EVAL_PHASES / (NUM_SQUARES - 3);
+}
+
+int eval_phase(const position_t *pos) {
+	return phase_of(bb_count(pos->player | pos->opponent));
+}
+
+/**
+ * Writes where in a phase's weights every pattern of pos looks, EVAL_INSTANCES of them
+ */
+void eval_features(const position_t *pos, int *features) {
+	int i, j;
+
+	for (i = 0; i < num_instances; i++) {
+		int index = 0;
+
+		for (j = 0; j < instances[i].size; j++) {
+			int sq = instances[i].squares[j];
+			index = index * 3 + (int) ((pos->player >> sq) & 1) + 2 * (int) ((pos->opponent >> sq) & 1);
+		}
+		features[i] = instances[i].offset + index;
+	}
+}
+
+/**
+ * Adds up the weights of the given features, in 1/EVAL_SCALE of a disc.
+ * The sum is kept at that resolution, so that the search can tell apart
+ * moves less than a disc apart
+ */
+static int score_of(const int *features, int phase) {
+	const int16_t *table = weights + (size_t) phase * eval_table_size;
+	int i, sum = 0;
+
+	for (i = 0; i < num_instances; i++) sum += table[features[i]];
+	return (sum > NUM_SQUARES * EVAL_SCALE) ? NUM_SQUARES * EVAL_SCALE : (sum < -NUM_SQUARES * EVAL_SCALE) ? -NUM_SQUARES * EVAL_SCALE : sum;
+}
+
+/**
+ * Static evaluation from scratch: the sum of the pattern weights for the side to move, in 1/EVAL_SCALE of a disc
+ */
+int evaluate(const position_t *pos) {
+	int features[EVAL_INSTANCES];
+
+	eval_features(pos, features);
+	return score_of(features, eval_phase(pos));
+}
+
+/**
+ * Sets state up for pos, from scratch
+ */
+void eval_set(eval_state_t *state, const position_t *pos) {
+	position_t swapped = {pos->opponent, pos->player, 0, 0};
+
+	eval_features(pos, state->features[0]);
+	eval_features(&swapped, state->features[1]);
+	state->side = 0;
+	state->discs = bb_count(pos->player | pos->opponent);
+}
+
+/**
+ * Shifts the digit of sq in all its instances by mover_delta in the reading
+ * of the side to move and by other_delta in the other side's
+ */
+static void update_square(eval_state_t *state, int sq, int mover_delta, int other_delta) {
+	const square_instances_t *on = &square_instances[sq];
+	int *mover = state->features[state->side];
+	int *other = state->features[state->side ^ 1];
+	int k;
+
+	for (k = 0; k < on->count; k++) {
+		mover[on->instance[k]] += mover_delta * on->digit[k];
+		other[on->instance[k]] += other_delta * on->digit[k];
+	}
+}
+
+/**
+ * Plays sq, flipping flips, for the side to move; PASS passes.
+ * In the mover's reading a new disc goes from digit 0 to 1 and a flipped
+ * one from 2 to 1; in the other side's it is 0 to 2 and 1 to 2
+ */
+void eval_do_move(eval_state_t *state, int sq, uint64_t flips) {
+	if (sq != PASS) {
+		update_square(state, sq, 1, 2);
+		for (; flips; flips &= flips - 1) update_square(state, bb_first_square(flips), -1, 1);
+		state->discs++;
+	}
+	state->side ^= 1;
+}
+
+/**
+ * Takes back eval_do_move(state, sq, flips)
+ */
+void eval_undo_move(eval_state_t *state, int sq, uint64_t flips) {
+	state->side ^= 1;
+	if (sq != PASS) {
+		update_square(state, sq, -1, -2);
+		for (; flips; flips &= flips - 1) update_square(state, bb_first_square(flips), 1, -1);
+		state->discs--;
+	}
+}
+
+/**
+ * Static evaluation of the position state is at, for the side to move
+ */
+int eval_state_score(const eval_state_t *state) {
+	return score_of(state->features[state->side], phase_of(state->discs));
+}
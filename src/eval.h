@@ -0,0 +1,57 @@
+#ifndef _EVAL_H
+#define _EVAL_H
+
+#include <stdint.h>
+#include "bitboard.h"
+
+/*
+ * Pattern evaluation: the board is covered by lines, edges and corner
+ * regions, every one of them read as a base-3 number (0 empty, 1 side to
+ * move, 2 opponent) that indexes a table of weights. The tables are shared
+ * by all the symmetric copies of a pattern, and there is one set of them
+ * for every stage of the game, by the number of discs on the board.
+ */
+#define EVAL_PHASES 12
+#define EVAL_SCALE 128			/* weights are in 1/EVAL_SCALE of a disc */
+#define EVAL_MAX_PATTERN 10		/* squares in the largest pattern */
+#define EVAL_INSTANCES 46		/* patterns on the board, symmetric copies included */
+
+/* Weight file: this header, then EVAL_PHASES tables of table_size int16 weights each, in the byte order of the machine */
+#define EVAL_FILE_MAGIC 0x5748544FU	/* "OTHW" */
+#define EVAL_FILE_VERSION 1
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t phases;
+	uint32_t table_size;		/* weights in one phase, over all patterns */
+	uint32_t scale;
+} eval_file_header_t;
+
+/*
+ * The pattern indices of the position a search is walking, kept up to date
+ * move by move instead of being read off the board at every leaf.
+ * features[c] reads the board with colour c as the side to move, colour 0
+ * being the side to move of the position the state was set up from.
+ */
+typedef struct {
+	int features[2][EVAL_INSTANCES];
+	int side;			/* colour to move */
+	int discs;			/* discs on the board, which gives the phase */
+} eval_state_t;
+
+extern int eval_table_size;
+extern int eval_weights_loaded;
+
+int eval_init(const char *path);
+void eval_free(void);
+int eval_phase(const position_t *pos);
+void eval_features(const position_t *pos, int *features);
+int eval_save(const char *path, const int16_t *weights);
+const int16_t *eval_weights(void);
+int evaluate(const position_t *pos);
+void eval_set(eval_state_t *state, const position_t *pos);
+void eval_do_move(eval_state_t *state, int sq, uint64_t flips);
+void eval_undo_move(eval_state_t *state, int sq, uint64_t flips);
+int eval_state_score(const eval_state_t *state);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "comms.h"
+#include "hash.h"
+
+/*
+ * The table is an array of two-entry buckets. The first entry of a bucket
+ * keeps the deepest result seen for that slot; the second always takes the
+ * newest store, so shallow results near the leaves still get cached.
+ * The table lasts the whole game: every entry carries the age of the search
+ * that stored it, and a deep entry left over from an earlier search gives
+ * way to anything the current one stores, while it can still be probed.
+ */
+#define BUCKET_SIZE TT_BUCKET_SIZE
+
+static tt_entry_t *table = NULL;
+static uint64_t bucket_mask = 0;
+static uint8_t age = 0;
+
+/*
+ * Ranks on the same host can share one table through an MPI shared memory
+ * window instead of each allocating its own. The first rank of the host
+ * allocates the whole table and the others map it; the key ^ data check
+ * makes concurrent writers from different processes as safe as from
+ * different threads.
+ */
+static int shared = 0;
+static MPI_Comm node_comm;
+static MPI_Win node_window;
+static int node_rank;
+
+/**
+ * Returns the number of buckets in a table of (at most) the given size in
+ * megabytes, rounded down to a power of two
+ */
+static uint64_t buckets_in(uint64_t megabytes) {
+	uint64_t bytes = megabytes << 20;
+	uint64_t buckets = 1;
+
+	while (buckets * 2 * BUCKET_SIZE * sizeof(tt_entry_t) <= bytes) buckets *= 2;
+	return buckets;
+}
+
+/**
+ * Allocates a table of (at most) the given size in megabytes, rounded down
+ * to a power of two number of buckets
+ */
+int tt_init(int megabytes) {
+	uint64_t buckets = buckets_in(megabytes);
+
+	tt_free();
+	table = malloc(buckets * BUCKET_SIZE * sizeof(tt_entry_t));
+	if (table == NULL) return FAILURE;
+	bucket_mask = buckets - 1;
+	tt_clear();
+	return SUCCESS;
+}
+
+/**
+ * Sets up one table for all ranks on this host, of megabytes for each of
+ * them. Collective over all ranks. With a single rank on the host it is a
+ * private table as tt_init would make
+ */
+int tt_init_shared(int megabytes) {
+	uint64_t buckets;
+	MPI_Aint size;
+	int disp_unit, node_size;
+
+	tt_free();
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+	MPI_Comm_size(node_comm, &node_size);
+	MPI_Comm_rank(node_comm, &node_rank);
+	if (node_size == 1) {
+		MPI_Comm_free(&node_comm);
+		return tt_init(megabytes);
+	}
+
+	buckets = buckets_in((uint64_t) megabytes * node_size);
+	size = (node_rank == 0) ? (MPI_Aint) (buckets * BUCKET_SIZE * sizeof(tt_entry_t)) : 0;
+	if (MPI_Win_allocate_shared(size, sizeof(tt_entry_t), MPI_INFO_NULL, node_comm, &table, &node_window) != MPI_SUCCESS) {
+		MPI_Comm_free(&node_comm);
+		table = NULL;
+		return FAILURE;
+	}
+	MPI_Win_shared_query(node_window, 0, &size, &disp_unit, &table);
+	shared = 1;
+	bucket_mask = buckets - 1;
+	tt_clear();
+	/* nobody uses the table before it has been cleared */
+	MPI_Barrier(node_comm);
+	return SUCCESS;
+}
+
+/**
+ * Frees the table; collective over all ranks if it is shared
+ */
+void tt_free(void) {
+	if (shared) {
+		MPI_Win_free(&node_window);
+		MPI_Comm_free(&node_comm);
+		shared = 0;
+	} else {
+		free(table);
+	}
+	table = NULL;
+}
+
+/**
+ * Empties the table. A shared table is cleared by the first rank of the
+ * host only; entries the others store meanwhile are still valid
+ */
+void tt_clear(void) {
+	if (shared && node_rank != 0) return;
+	memset(table, 0, (bucket_mask + 1) * BUCKET_SIZE * sizeof(tt_entry_t));
+}
+
+/**
+ * Starts a new search: entries stored so far become the old ones that are
+ * replaced first. The distributed table shares the age, which every rank
+ * moves on at the same searches
+ */
+void tt_new_search(void) {
+	age++;
+}
+
+/**
+ * Looks for key in a bucket, which may be a copy fetched from another rank.
+ * Copies the entry into entry and returns 1, or returns 0 on a miss
+ */
+int tt_read_bucket(const volatile tt_words_t *bucket, uint64_t key, tt_entry_t *entry) {
+	int i;
+
+	for (i = 0; i < BUCKET_SIZE; i++) {
+		tt_words_t words = {bucket[i].check, bucket[i].data};
+
+		if ((words.check ^ words.data) == key) {
+			memcpy(entry, &words, sizeof(tt_entry_t));
+			entry->key = key;
+			if (entry->bound != BOUND_NONE) return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Returns the slot of the bucket a result for key at depth should go to
+ */
+int tt_pick_slot(const volatile tt_words_t *bucket, uint64_t key, int depth) {
+	tt_words_t words = {bucket[0].check, bucket[0].data};
+	tt_entry_t first;
+
+	memcpy(&first, &words, sizeof(tt_entry_t));
+	return ((words.check ^ words.data) == key || depth >= first.depth || first.age != age) ? 0 : 1;
+}
+
+/**
+ * Returns the two words to write for an entry
+ */
+tt_words_t tt_pack(uint64_t key, int depth, int score, int bound, int move) {
+	tt_entry_t entry = {0};
+	tt_words_t words;
+
+	entry.score = (int16_t) score;
+	entry.depth = (int8_t) depth;
+	entry.bound = (uint8_t) bound;
+	entry.move = (int8_t) move;
+	entry.age = age;
+	memcpy(&words, &entry, sizeof(tt_words_t));
+	words.check = key ^ words.data;
+	return words;
+}
+
+/**
+ * Copies the entry stored for key into entry and returns 1, or returns 0 on a miss
+ */
+int tt_probe(uint64_t key, tt_entry_t *entry) {
+	return tt_read_bucket((volatile tt_words_t *) &table[(key & bucket_mask) * BUCKET_SIZE], key, entry);
+}
+
+void tt_store(uint64_t key, int depth, int score, int bound, int move) {
+	volatile tt_words_t *bucket = (volatile tt_words_t *) &table[(key & bucket_mask) * BUCKET_SIZE];
+	volatile tt_words_t *slot = &bucket[tt_pick_slot(bucket, key, depth)];
+	tt_words_t words = tt_pack(key, depth, score, bound, move);
+
+	slot->check = words.check;
+	slot->data = words.data;
+}
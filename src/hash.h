@@ -0,0 +1,47 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stdint.h>
+
+#define BOUND_NONE 0
+#define BOUND_UPPER 1
+#define BOUND_LOWER 2
+#define BOUND_EXACT 3
+
+/* One transposition table entry, 16 bytes */
+typedef struct {
+	uint64_t key;
+	int16_t score;
+	int8_t depth;
+	uint8_t bound;
+	int8_t move;	/* best move found, or PASS */
+	uint8_t age;	/* search that stored it, see tt_new_search */
+	uint8_t pad[2];
+} tt_entry_t;
+
+/*
+ * The table is shared without locks. An entry is two 64-bit words, and the
+ * first one is stored as key ^ second, so an entry torn by two writers at
+ * once no longer matches its key and reads as a miss.
+ */
+typedef struct {
+	uint64_t check;
+	uint64_t data;
+} tt_words_t;
+
+/* Entries per bucket: the first keeps the deepest result seen in the current search, the second always takes the newest */
+#define TT_BUCKET_SIZE 2
+
+int tt_read_bucket(const volatile tt_words_t *bucket, uint64_t key, tt_entry_t *entry);
+int tt_pick_slot(const volatile tt_words_t *bucket, uint64_t key, int depth);
+tt_words_t tt_pack(uint64_t key, int depth, int score, int bound, int move);
+
+int tt_init(int megabytes);
+int tt_init_shared(int megabytes);
+void tt_free(void);
+void tt_clear(void);
+void tt_new_search(void);
+int tt_probe(uint64_t key, tt_entry_t *entry);
+void tt_store(uint64_t key, int depth, int score, int bound, int move);
+
+#endif
@@ -0,0 +1,43 @@
+#include <stdlib.h>
+#include "options.h"
+
+options_t options;
+
+/**
+ * Returns the integer value of an environment variable, or fallback if it
+ * is unset or negative
+ */
+static int env_int(const char *name, int fallback) {
+	const char *value = getenv(name);
+	int n;
+
+	if (value == NULL || *value == '\0') return fallback;
+	n = atoi(value);
+	return (n >= 0) ? n : fallback;
+}
+
+/**
+ * Returns the value of an environment variable, or fallback if it is unset or empty
+ */
+static const char *env_string(const char *name, const char *fallback) {
+	const char *value = getenv(name);
+
+	return (value == NULL || *value == '\0') ? fallback : value;
+}
+
+void options_load(void) {
+	options.hash_mb = env_int("OTHELLO_HASH_MB", 64);
+	options.shared_tt = env_int("OTHELLO_SHARED_TT", 1);
+	options.threads = env_int("OTHELLO_THREADS", 1);
+	options.split_depth = env_int("OTHELLO_SPLIT_DEPTH", 6);
+	options.tds = env_int("OTHELLO_TDS", 0);
+	options.tds_local_depth = env_int("OTHELLO_TDS_LOCAL_DEPTH", 4);
+	options.dtt_mb = env_int("OTHELLO_DTT_MB", 0);
+	options.dtt_depth = env_int("OTHELLO_DTT_DEPTH", 5);
+	options.ordering = env_int("OTHELLO_ORDERING", 1);
+	options.sort_depth = env_int("OTHELLO_SORT_DEPTH", 4);
+	options.solve_empties = env_int("OTHELLO_SOLVE_EMPTIES", 20);
+	options.ponder = env_int("OTHELLO_PONDER", 1);
+	options.weights = env_string("OTHELLO_WEIGHTS", "player/weights.bin");
+	options.book = env_string("OTHELLO_BOOK", "player/book.bin");
+}
@@ -0,0 +1,30 @@
+#ifndef _OPTIONS_H
+#define _OPTIONS_H
+
+/*
+ * Engine settings. The referee starts my_player with a fixed set of
+ * arguments, so these are read from OTHELLO_* environment variables,
+ * which mpirun hands on to every rank.
+ */
+typedef struct {
+	int hash_mb;		/* OTHELLO_HASH_MB: transposition table size per rank */
+	int shared_tt;		/* OTHELLO_SHARED_TT: ranks on the same host pool their tables into one */
+	int threads;		/* OTHELLO_THREADS: search threads per rank, sharing its transposition table */
+	int split_depth;	/* OTHELLO_SPLIT_DEPTH: shallowest remaining depth at which a node's moves may go to other ranks */
+	int tds;		/* OTHELLO_TDS: 1 for transposition-driven scheduling instead of Young Brothers Wait */
+	int tds_local_depth;	/* OTHELLO_TDS_LOCAL_DEPTH: positions this shallow are searched where they land */
+	int dtt_mb;		/* OTHELLO_DTT_MB: share of the distributed transposition table on each rank, 0 for none */
+	int dtt_depth;		/* OTHELLO_DTT_DEPTH: shallowest remaining depth that probes and stores the distributed table */
+	int ordering;		/* OTHELLO_ORDERING: 0 searches moves in square order, for measuring what ordering gains */
+	const char *weights;	/* OTHELLO_WEIGHTS: evaluation weight file, built-in weights if it cannot be read */
+	const char *book;	/* OTHELLO_BOOK: opening book file, played from by rank 0 alone */
+	int solve_empties;	/* OTHELLO_SOLVE_EMPTIES: with this few empty squares the game is played out to the end instead of deepening */
+	int sort_depth;		/* OTHELLO_SORT_DEPTH: shallowest remaining depth at which moves are also sorted by the opponent's mobility */
+	int ponder;		/* OTHELLO_PONDER: search the expected reply while the opponent thinks */
+} options_t;
+
+extern options_t options;
+
+void options_load(void);
+
+#endif
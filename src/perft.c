@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <mpi.h>
+#include "comms.h"
+#include "perft.h"
+
+/**
+ * Reads a position written as 64 squares row by row from the top left
+ * ('b'/'x' black, 'w'/'o' white, '.'/'-' empty), followed by the side to
+ * move ('b' or 'w', spaces allowed in between; black if left out)
+ */
+int parse_position(const char *text, position_t *pos, int *black_to_move) {
+	uint64_t black = 0, white = 0;
+	int sq = 0;
+
+	for (; *text != '\0' && sq < NUM_SQUARES; text++) {
+		switch (tolower((unsigned char) *text)) {
+		case 'b': case 'x': black |= SQUARE_BIT(sq++); break;
+		case 'w': case 'o': white |= SQUARE_BIT(sq++); break;
+		case '.': case '-': sq++; break;
+		default: return FAILURE;
+		}
+	}
+	if (sq != NUM_SQUARES) return FAILURE;
+
+	while (isspace((unsigned char) *text)) text++;
+	switch (tolower((unsigned char) *text)) {
+	case '\0': case 'b': case 'x': *black_to_move = 1; break;
+	case 'w': case 'o': *black_to_move = 0; break;
+	default: return FAILURE;
+	}
+
+	pos->player = *black_to_move ? black : white;
+	pos->opponent = *black_to_move ? white : black;
+	bb_hash_position(pos);
+	return SUCCESS;
+}
+
+/**
+ * Counts the leaves of the game tree below pos, depth plies deep.
+ * A pass counts as a ply; a finished game is a leaf wherever it happens
+ */
+uint64_t perft(const position_t *pos, int depth, int passed) {
+	uint64_t moves, nodes = 0;
+	position_t next;
+
+	if (depth == 0) return 1;
+
+	moves = bb_legal_moves(pos->player, pos->opponent);
+	if (moves == 0) {
+		if (passed) return 1;
+		next = *pos;
+		bb_pass(&next);
+		return perft(&next, depth - 1, 1);
+	}
+	if (depth == 1) return bb_count(moves);
+
+	for (; moves; moves &= moves - 1) {
+		int sq = bb_first_square(moves);
+		next = *pos;
+		bb_make_move(&next, sq, bb_flips(sq, next.player, next.opponent));
+		nodes += perft(&next, depth - 1, 0);
+	}
+	return nodes;
+}
+
+/**
+ * --perft <depth> [position]
+ * Runs perft from the given position (the starting position by default).
+ * The root moves are dealt out round robin over the MPI ranks and the
+ * leaf counts summed at rank 0, which reports the node rate.
+ */
+int run_perft(int argc, char *argv[]) {
+	int rank, comm_sz, depth, black_to_move = 1;
+	int moves[NUM_SQUARES];
+	int num_moves, i;
+	uint64_t nodes = 0, total = 0;
+	position_t pos, next;
+	double start, elapsed;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+	depth = (argc >= 3) ? atoi(argv[2]) : 0;
+	bb_init_position(&pos);
+	if (depth < 1 || (argc >= 4 && parse_position(argv[3], &pos, &black_to_move) == FAILURE)) {
+		if (rank == 0) fprintf(stderr, "Arguments: --perft <depth> [position]\n");
+		return FAILURE;
+	}
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	start = MPI_Wtime();
+
+	num_moves = bb_to_list(bb_legal_moves(pos.player, pos.opponent), moves);
+	if (num_moves == 0) {
+		//nothing to split at a pass, so rank 0 counts the whole tree
+		if (rank == 0) nodes = perft(&pos, depth, 0);
+	} else if (depth == 1) {
+		if (rank == 0) nodes = num_moves;
+	} else {
+		for (i = rank; i < num_moves; i += comm_sz) {
+			next = pos;
+			bb_make_move(&next, moves[i], bb_flips(moves[i], next.player, next.opponent));
+			nodes += perft(&next, depth - 1, 0);
+		}
+	}
+
+	MPI_Reduce(&nodes, &total, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	elapsed = MPI_Wtime() - start;
+
+	if (rank == 0) {
+		printf("perft %d (%s to move, %d ranks, %s kernels): %llu nodes in %.3f s, %.0f nodes/s\n",
+			depth, black_to_move ? "black" : "white", comm_sz, bb_kernel_name(),
+			(unsigned long long) total, elapsed, elapsed > 0 ? total / elapsed : 0.0);
+		fflush(stdout);
+	}
+	return SUCCESS;
+}
@@ -0,0 +1,11 @@
+#ifndef _PERFT_H
+#define _PERFT_H
+
+#include <stdint.h>
+#include "bitboard.h"
+
+int parse_position(const char *text, position_t *pos, int *black_to_move);
+uint64_t perft(const position_t *pos, int depth, int passed);
+int run_perft(int argc, char *argv[]);
+
+#endif
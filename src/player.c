@@ -41,21 +41,37 @@
 #include <mpi.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 #include "comms.h"
+#include "bitboard.h"
+#include "perft.h"
+#include "hash.h"
+#include "dtt.h"
+#include "options.h"
+#include "search.h"
+#include "scheduler.h"
+#include "tds.h"
+#include "endgame.h"
+#include "eval.h"
+#include "book.h"
 
 const int EMPTY = 0;
 const int BLACK = 1;
 const int WHITE = 2;
 
 const int OUTER = 3;
-const int ALLDIRECTIONS[8] = {-11, -10, -9, -1, 1, 9, 10, 11};
 const int BOARDSIZE = 100;
 
 const int LEGALMOVSBUFSIZE = 65;
+//Share of the referee's per-move time limit the search may use, the rest covers communication
+const double TIME_USAGE = 0.8;
+const int MAX_DEPTH = 60;
+//Time budget of a search on the opponent's time: it runs until the referee speaks
+const double PONDER_BUDGET = 1e6;
 const char piecenames[4] = {'.','b','w','?'};
 
 void run_master(int argc, char *argv[]);
-int initialise_master(int argc, char *argv[], int *time_limit, int *my_colour, FILE **fp);
+int initialise_master(int argc, char *argv[], double *time_limit, int *my_colour, FILE **fp);
 void gen_move_master(char *move, int my_colour, FILE *fp);
 void apply_opp_move(char *move, int my_colour, FILE *fp);
 void game_over();
@@ -63,17 +79,12 @@ void run_worker();
 void initialise_board();
 void free_board();
 void legal_moves(int player, int *moves, FILE *fp);
-int legalp(int move, int player, FILE *fp);
-int validp(int move);
-int would_flip(int move, int dir, int player, FILE *fp);
 int opponent(int player, FILE *fp);
-int find_bracket_piece(int square, int dir, int player, FILE *fp);
 int random_strategy(int my_colour, FILE *fp);
 void random_strategy_2(int *moves, int buffer_size, int *best_move);
 void make_move(int move, int player, FILE *fp);
-void make_flips(int move, int dir, int player, FILE *fp);
-int get_loc(char* movestring);
-void get_move_string(int loc, char *ms);
+position_t position_of(int player);
+void update_mailbox();
 void print_board(FILE *fp);
 char nameof(int piece);
 int count(int player, int * board);
@@ -81,32 +92,98 @@ FILE* open_logfile(int colour);
 void close_logfile(FILE* fptr);
 FILE* open_logfile1(int colour);
 FILE* open_logfile_2(int colour);
-void gen_move_master3(char *move, int my_colour, FILE *fp, FILE*masterPtr);
-void search_for_best_move(int *moves, int buffer_size, int *best_move, int player, FILE *ptr);
-int minimax(int *board, int move, int depth, int maximizing_player, int current_player, int alpha, int beta, FILE *ptr);
-
-//The functions below are copies of the function provided in the skeleton code with a few minor changes
-//Instead of changing the contents of the global board they all work together to change the state of a local board sent in the parameters
-void legal_moves_1(int player, int *moves, int *board_modified); 
-int legalp_1(int move, int player, int* board_modified);
-void make_modified_move(int move, int *board_modified, int player);
-void make_flips_1(int move, int dir, int player, int *board_modified);
-int would_flip_1(int move, int dir, int player, int *board_modified);
+void gen_move_master3(char *move, int my_colour, FILE *fp, FILE*masterPtr, double budget);
+int book_move_master(char *move, int my_colour, FILE *fp, FILE *masterPtr);
+int pondered_move_master(char *move, int my_colour, FILE *fp, FILE *masterPtr);
+int ponder_master(char *cmd, char *opponent_move, int *cmd_status, int my_colour, FILE *fp, FILE *masterPtr);
+void *listen_to_referee(void *arg);
+void search_master(int my_colour, double budget, FILE *masterPtr);
+void play_move_master(int loc, char *move, int my_colour, FILE *fp);
+int predict_reply(int my_colour);
+void sort_root_moves(int *moves, int *scores, int num_moves);
 int opponent_1(int player);
-int find_bracket_piece_1(int square, int dir, int player, int *board_modified);
-int static_evaluation(int *board_modified, int player_type, FILE *ptr);
-void print_board_1(FILE *fp, int *local_board);
 
+//The game state: one disc mask per colour, indexed by BLACK and WHITE
+uint64_t discs[3];
+//Mailbox copy of the game state, only kept up to date for print_board
 int *board;
 
+//What the last search of process 0 found. A search on the opponent's time is picked up from here when the opponent
+//plays the reply it expected
+typedef struct
+{
+	uint64_t discs[3];		//the position searched
+	int colour;			//side to move in it
+	int num_moves;
+	int moves[64];			//its moves, best first
+	int best_move;			//-1 to pass
+	int evaluation;
+	int depth;			//last iteration that completed, 0 for none
+	int solve_pass;			//solving passes that completed, see search_master
+	int finished;			//no further iteration could change the answer
+} search_result_t;
+search_result_t last_search;
+
+//The referee's next command, read by a second thread while the search runs on the opponent's time
+typedef struct
+{
+	char *cmd;
+	char *move;
+	int status;
+} listener_t;
+
 int main(int argc, char *argv[]) {
 	int rank;
+	int thread_support;
 
-	MPI_Init(&argc, &argv);
+	//Search threads never call MPI, only the main thread of every process does
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
  
+	options_load();
+	if (thread_support < MPI_THREAD_FUNNELED) options.threads = 1;
+	bb_init_kernels(); //picks the move generation kernels for this CPU
+	bb_init_zobrist();
 	initialise_board(); //one for each process
 
+	//Move generator validation and benchmarking mode, run without the referee
+	if (argc >= 2 && strcmp(argv[1], "--perft") == 0) {
+		run_perft(argc, argv);
+		game_over();
+		return 0;
+	}
+	//Endgame solver benchmark: the same positions with and without the last-moves kernels
+	if (argc >= 2 && strcmp(argv[1], "--endgame") == 0) {
+		run_endgame(argc, argv);
+		game_over();
+		return 0;
+	}
+
+	//The transposition table and a search stack per thread are allocated once for the whole game.
+	//Processes on the same host share one table, of hash_mb for each of them, unless OTHELLO_SHARED_TT=0
+	int table_status = options.shared_tt ? tt_init_shared(options.hash_mb) : tt_init(options.hash_mb);
+	if (table_status == FAILURE && tt_init(1) == FAILURE) {
+		fprintf(stderr, "Could not allocate the transposition table\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	//The distributed table is optional and is the same size on every process, so they either all get it or all go without
+	if (dtt_init(options.dtt_mb) == FAILURE) {
+		fprintf(stderr, "Could not allocate the distributed transposition table\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (search_init() == FAILURE || scheduler_init() == FAILURE || tds_init() == FAILURE) {
+		fprintf(stderr, "Could not allocate the search stack\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	//Process 0 reads the evaluation weights (OTHELLO_WEIGHTS) and hands them on; without a weight file every process uses built-in ones
+	if (eval_init(options.weights) == FAILURE) {
+		fprintf(stderr, "Could not allocate the evaluation weights\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	//Only process 0 plays from the opening book, so only it maps the file; a missing book just means searching every move
+	if (rank == 0) book_open(options.book);
+
 	if (rank == 0) {
 	    run_master(argc, argv);
 	} else {
@@ -119,7 +196,7 @@ void run_master(int argc, char *argv[]) {
 	char cmd[CMDBUFSIZE];
 	char my_move[MOVEBUFSIZE];
 	char opponent_move[MOVEBUFSIZE];
-	int time_limit;
+	double time_limit = 0;
 	int my_colour;
 	int running = 0;
 	FILE *fp = NULL;
@@ -135,10 +212,20 @@ void run_master(int argc, char *argv[]) {
 	//File pointer created to print to a file everything that happens in the master process(process 0)
 	FILE *masterPtr = open_logfile1(my_colour);
 	fprintf(masterPtr, "Sam you beauty, your colour is %d\n", my_colour);
+	fprintf(masterPtr, "Move generation kernels: %s\n", bb_kernel_name());
+	fprintf(masterPtr, "Search threads per process: %d\n", options.threads);
+	fprintf(masterPtr, "Evaluation weights: %s\n", eval_weights_loaded ? options.weights : "built in");
+	fprintf(masterPtr, "Opening book: %ld positions\n", book_size);
+
+	//Set when the next command has already been read, while pondering
+	int pondered = 0;
+	int cmd_status = SUCCESS;
 
 	while (running == 1) {
 		/* Receive next command from referee */
-		if (comms_get_cmd(cmd, opponent_move) == FAILURE) {
+		if (!pondered) cmd_status = comms_get_cmd(cmd, opponent_move);
+		pondered = 0;
+		if (cmd_status == FAILURE) {
 			fprintf(fp, "Error getting cmd\n");
 			fflush(fp);
 			running = 0;
@@ -155,15 +242,14 @@ void run_master(int argc, char *argv[]) {
 
 		/* Received gen_move message */
 		} else if (strcmp(cmd, "gen_move") == 0) {
-			// Broadcast running
-			//When the player receives a generate move command it sends it to all the processes and they begin to execute
-			MPI_Bcast(&running, 1, MPI_INT, 0, MPI_COMM_WORLD);
-			// Broadcast board 
-			//The board is broadcasted to all the processes
-			MPI_Bcast(board, 100, MPI_INT, 0, MPI_COMM_WORLD);
-			//The function below retrieves the best move, puts it into string format and then places it in the my_move variable
-			//The function coordinates the evaluation of all of the legal moves
-			gen_move_master3(my_move, my_colour, fp, masterPtr);
+			//A book move, or one the search on the opponent's time already settled, is played straight away;
+			//the other processes keep waiting for the next position to search
+			if (book_move_master(my_move, my_colour, fp, masterPtr) == FAILURE && pondered_move_master(my_move, my_colour, fp, masterPtr) == FAILURE)
+			{
+				//The function below retrieves the best move, puts it into string format and then places it in the my_move variable
+				//The function coordinates the evaluation of all of the legal moves
+				gen_move_master3(my_move, my_colour, fp, masterPtr, time_limit * TIME_USAGE);
+			}
 			
 			//gen_move_master(my_move, my_colour, fp);
 			print_board(fp);
@@ -174,6 +260,8 @@ void run_master(int argc, char *argv[]) {
 				fflush(fp);
 				break;
 			}
+			//Instead of idling until the opponent has moved, every process searches the reply it is expected to play
+			if (options.ponder) pondered = ponder_master(cmd, opponent_move, &cmd_status, my_colour, fp, masterPtr);
 
 		/* Received opponent's move (play_move mesage) */
 		} else if (strcmp(cmd, "play_move") == 0) {
@@ -190,13 +278,13 @@ void run_master(int argc, char *argv[]) {
 	MPI_Bcast(&running, 1, MPI_INT, 0, MPI_COMM_WORLD);
 }
 
-int initialise_master(int argc, char *argv[], int *time_limit, int *my_colour, FILE **fp) {
+int initialise_master(int argc, char *argv[], double *time_limit, int *my_colour, FILE **fp) {
 	int result = FAILURE;
 
 	if (argc == 5) { 
 		unsigned long ip = inet_addr(argv[1]);
 		int port = atoi(argv[2]);
-		*time_limit = atoi(argv[3]);
+		*time_limit = atof(argv[3]);
 
 		*fp = fopen(argv[4], "w");
 		if (*fp != NULL) {
@@ -217,13 +305,19 @@ int initialise_master(int argc, char *argv[], int *time_limit, int *my_colour, F
 
 void initialise_board() {
 	int i;
+	position_t start;
 	board = (int *) malloc(BOARDSIZE * sizeof(int));
 	for (i = 0; i <= 9; i++) board[i] = OUTER;
 	for (i = 10; i <= 89; i++) {
 		if (i%10 >= 1 && i%10 <= 8) board[i] = EMPTY; else board[i] = OUTER;
 	}
 	for (i = 90; i <= 99; i++) board[i] = OUTER;
-	board[44] = WHITE; board[45] = BLACK; board[54] = BLACK; board[55] = WHITE;
+
+	bb_init_position(&start);
+	discs[EMPTY] = 0;
+	discs[BLACK] = start.player;
+	discs[WHITE] = start.opponent;
+	update_mailbox();
 }
 
 void free_board() {
@@ -259,46 +353,36 @@ void run_worker() {
 
 	while (running == 1) {
 		// Broadcast board
-		MPI_Bcast(board, 100, MPI_INT, 0, MPI_COMM_WORLD);
-		
-
-		//moves variables
-		int buffer_size = 0;
-		int *receive_buffer = (int*)malloc(sizeof(int) * 15); 
-		int *send_counts = (int*)malloc(sizeof(int) * comm_sz);
-		//The send_counts array is broadcasted to all the processes. It specifies the buffer size of each of the processes.
-		//The processes will not always have the same number of elements but the biggest difference in buffer size will always be 1.
-		MPI_Bcast(send_counts, comm_sz, MPI_INT, 0, MPI_COMM_WORLD);
-
-		// Generate move        
-		for (int i = 1; i < comm_sz; i++)
+		MPI_Bcast(discs, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+		// Broadcast time budget
+		double budget;
+		MPI_Bcast(&budget, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+		start_search_clock(budget);
+		//The table, killers and history of the last search carry over to this one
+		position_t root = position_of(my_colour);
+		start_new_root(&root);
+
+		//Iterative deepening: every iteration process 0 searches the root and this process helps out
+		//by asking for moves of nodes whose eldest move is done (Young Brothers Wait), see scheduler.c.
+		int keep_searching = 1;
+		for (int depth = 1; keep_searching; depth++)
 		{
-			if (my_rank == i)
-			{	
-				//buffer_size variable for each process
-				buffer_size = send_counts[i];
+			reset_search_stats();
+			if (options.tds)
+			{
+				tds_search_worker();
 			}
-		} 
-		//Receives a subset of all the legal moves and loads it into the variable receive_buffer
-		MPI_Scatterv(NULL, NULL, NULL, MPI_DATATYPE_NULL, receive_buffer, buffer_size, MPI_INT, 0, MPI_COMM_WORLD);
-		//fprintf(slavePtr, "The receive buffer of process %d looks like ", my_rank);
-		for (int j = 0; j < buffer_size; j++)
-		{
-			fprintf(slavePtr, "%d\t", receive_buffer[j]);
+			else
+			{
+				schedule_root_worker();
+			}
+			//How the work was spread over the processes shows in the node counts of each iteration
+			fprintf(slavePtr, "Depth %d: %ld nodes\n", depth, search_stats.nodes);
+			//The search counters are summed at process 0
+			MPI_Reduce(&search_stats, NULL, SEARCH_STATS_FIELDS, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+			MPI_Bcast(&keep_searching, 1, MPI_INT, 0, MPI_COMM_WORLD);
 		}
-		fprintf(slavePtr, "\n");
-		free(send_counts);
-		int *best_move = (int*)malloc(sizeof(int) * 2);
-		//random_strategy_2(receive_buffer, buffer_size, best_move);
-		//Function loads the best move and its evaluation in the array best move
-		//The best move is placed at index 0 of the array
-		//The evaluation of that move is placed at index 1 of the array
-		search_for_best_move(receive_buffer, buffer_size, best_move, my_colour, slavePtr);
-		//The gather function joins all of the best_move arrays into one array and sends this array to process 0
-		MPI_Gatherv(best_move, 2, MPI_INT, NULL, NULL, NULL, MPI_DATATYPE_NULL, 0, MPI_COMM_WORLD);
-		//fprintf(slavePtr, "The best move of the subset of moves is %d with an evaluation of %d\n", best_move[0], best_move[1]);
-		//fprintf(slavePtr, "\n");
-		free(best_move);
+		fflush(slavePtr);
 
 		// Broadcast running
 		MPI_Bcast(&running, 1, MPI_INT, 0, MPI_COMM_WORLD);
@@ -329,111 +413,288 @@ void gen_move_master(char *move, int my_colour, FILE *fp) {
 	}
 }
 
-void gen_move_master3(char *move, int my_colour, FILE *fp, FILE*masterPtr) {
-	
-	int comm_sz;
-	MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
-	int *all_legal_moves = (int*)malloc(sizeof(int) * LEGALMOVSBUFSIZE);
-	memset(all_legal_moves, 0, LEGALMOVSBUFSIZE);
-	legal_moves(my_colour, all_legal_moves, fp);
+int book_move_master(char *move, int my_colour, FILE *fp, FILE *masterPtr)
+{
+	//Plays the opening book's move if the book knows the position (in any of its 8 symmetric forms);
+	//FAILURE means the position has to be searched
+	position_t root = position_of(my_colour);
+	int score;
+	int loc = book_move(&root, &score);
+	if (loc == PASS)
+	{
+		return FAILURE;
+	}
+	fprintf(masterPtr, "Book move %d with an evaluation of %d\n", loc, score);
+	get_move_string(loc, move);
+	make_move(loc, my_colour, fp);
+	return SUCCESS;
+}
+
+void gen_move_master3(char *move, int my_colour, FILE *fp, FILE*masterPtr, double budget) {
+	search_master(my_colour, budget, masterPtr);
+	fprintf(masterPtr, "The very best move is %d with an evaluation of %.2f\n", last_search.best_move, score_in_discs(last_search.evaluation));
+
+	int loc = last_search.best_move;
+	//int loc = random_strategy(my_colour, fp);
+	play_move_master(loc, move, my_colour, fp);
+}
+
+void play_move_master(int loc, char *move, int my_colour, FILE *fp) {
+	if (loc == -1) {
+		strncpy(move, "pass\n", MOVEBUFSIZE);
+	} else {
+		/* apply move */
+		get_move_string(loc, move);
+		make_move(loc, my_colour, fp);
+	}
+}
+
+/**
+ *  Searches the game state for my_colour together with all the processes, by iterative deepening within the budget,
+ *  and leaves the outcome in last_search. If last_search already holds a search of the same position, as after pondering
+ *  the reply the opponent then played, the search carries on from its last completed iteration with the table it filled
+ */
+void search_master(int my_colour, double budget, FILE *masterPtr) {
+	int all_legal_moves[LEGALMOVSBUFSIZE];
+	legal_moves(my_colour, all_legal_moves, NULL);
 
 	int number_legal_moves = all_legal_moves[0];
-	int elements_per_process = number_legal_moves/comm_sz;
-	int remainder = number_legal_moves%comm_sz;
-	int *receive_buffer = (int*)malloc(sizeof(int) * (elements_per_process+1));
-	int *send_counts = (int*)malloc(sizeof(int) * comm_sz);
-	int *displs = (int*)malloc(sizeof(int) * comm_sz);
-	int sum = 0;
-
-	//The for loop below fills the array send_counts up with the number of legal moves each process will receive
-	//For example is there is 14 legal moves and there are 4 processes then: Process0 = 4; Process1 = 4; Process2 = 3; Process3 = 3
-	//It divides the legal moves between the processes in a sensible way
-	for (int i = 0; i < comm_sz; i++)
+	int root_moves[LEGALMOVSBUFSIZE];
+	int root_scores[LEGALMOVSBUFSIZE];
+	for (int j = 0; j < number_legal_moves; j++)
+	{
+		root_moves[j] = all_legal_moves[j+1];
+	}
+	position_t root = position_of(my_colour);
+
+	//Until an iteration completes the first legal move is played
+	int best_move_loc = (number_legal_moves > 0) ? root_moves[0] : -1;
+	int evaluation = -SCORE_INF;
+	int first_depth = 1;
+	long previous_nodes = 0;
+	int empties = 64 - bb_count(discs[BLACK] | discs[WHITE]);
+	int keep_searching = 1;
+	//Close to the end (see OTHELLO_SOLVE_EMPTIES) the iterations only go halfway down, to order the moves. Then the game is played
+	//out to the end twice: first with a null window around a draw, which only tells whether it is won, drawn or lost but takes
+	//a fraction of the time, then for the exact score on the side of the draw the first pass found
+	int solving = !options.tds && empties <= options.solve_empties;
+	int solve_pass = 0;
+
+	int resuming = last_search.depth > 0 && last_search.colour == my_colour && memcmp(last_search.discs, discs, sizeof(discs)) == 0;
+	if (resuming)
 	{
-		send_counts[i] = elements_per_process;
-		if (remainder > 0)
+		memcpy(root_moves, last_search.moves, number_legal_moves * sizeof(int));
+		best_move_loc = last_search.best_move;
+		evaluation = last_search.evaluation;
+		first_depth = last_search.depth + 1;
+		solve_pass = last_search.solve_pass;
+		fprintf(masterPtr, "Carrying on from depth %d of the search on the opponent's time\n", last_search.depth);
+	}
+	else
+	{
+		memcpy(last_search.discs, discs, sizeof(discs));
+		last_search.colour = my_colour;
+		last_search.depth = 0;
+		last_search.solve_pass = 0;
+	}
+	last_search.finished = 0;
+
+	// Broadcast running
+	//When the player receives a generate move command it sends it to all the processes and they begin to execute
+	int running = 1;
+	MPI_Bcast(&running, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	// Broadcast board 
+	//The board is broadcasted to all the processes
+	MPI_Bcast(discs, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+	//Every process gets the same time budget and starts its clock
+	MPI_Bcast(&budget, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	start_search_clock(budget);
+	double search_start = MPI_Wtime();
+	//The table, killers and history of the last search carry over to this one on every process
+	start_new_root(&root);
+
+	//If the opponent played the reply the last search expected, it went through this position: the table still has its
+	//best move, which is searched first, and its score, which transposition-driven scheduling starts from
+	tt_entry_t known;
+	if (!resuming && tt_probe(root.key, &known))
+	{
+		for (int j = 1; j < number_legal_moves; j++)
 		{
-			send_counts[i]++;
-			remainder--;
+			if (root_moves[j] == known.move)
+			{
+				memmove(root_moves + 1, root_moves, j * sizeof(int));
+				root_moves[0] = known.move;
+				best_move_loc = known.move;
+			}
 		}
-		displs[i] = sum;
-		sum = sum + send_counts[i];
-		//fprintf(masterPtr, "The number of elements that are sent to process %d is %d\n", i, send_counts[i]);
-		//fprintf(masterPtr, "The displacement is %d\n", displs[i]);
+		if (known.bound == BOUND_EXACT) evaluation = known.score;
 	}
 
-	fprintf(masterPtr, "\n");
-	//The for loop below merely shifts the array so that the first legal move is at index 0 of the array
-	for (int j = 0; j < number_legal_moves; j++)
+	//Iterative deepening: this process searches the root every iteration. Once the eldest move of a deep enough node is done,
+	//its other moves go to whichever process asks for work, at the root and further down the tree (see scheduler.c).
+	//With OTHELLO_TDS=1 the positions are sent to the processes that own them in the table instead (see tds.c).
+	//An iteration only counts if every move was searched before the deadline.
+	for (int depth = first_depth; keep_searching; depth++)
 	{
-		all_legal_moves[j] = all_legal_moves[j+1];
-	}
-
-	int buffer_size = send_counts[0];
-	//MPI_Bcast function sends the send_counts array to each of the processes
-	MPI_Bcast(send_counts, comm_sz, MPI_INT, 0, MPI_COMM_WORLD);
-	//The scatter function breaks the all_legal_moves array in smaller arrays and sends these array to their respective processes
-	MPI_Scatterv(all_legal_moves, send_counts, displs, MPI_INT, receive_buffer, buffer_size, MPI_INT, 0, MPI_COMM_WORLD);
-	free(all_legal_moves);
-	free(send_counts);
-	free(displs); 
-	//fprintf(masterPtr, "The receive buffer of process 0 looks like ");
-	/*
-	for (int p = 0; p < buffer_size; p++)
+		reset_search_stats();
+		int move, score;
+		int completed;
+		int alpha = -SCORE_INF;
+		int beta = SCORE_INF;
+		if (solving && depth > empties / 2)
+		{
+			depth = empties;
+			if (solve_pass == 0)
+			{
+				alpha = -1;
+				beta = 1;
+			}
+			else if (evaluation > 0)
+			{
+				alpha = 0;
+			}
+			else
+			{
+				beta = 0;
+			}
+			solve_pass++;
+		}
+		if (options.tds)
+		{
+			//Transposition-driven scheduling searches the root position as a whole, starting from the previous evaluation
+			completed = tds_search_master(&root, depth, evaluation, &move, &score);
+		}
+		else
+		{
+			completed = schedule_root_master(&root, root_moves, number_legal_moves, depth, alpha, beta, root_scores, &move, &score);
+		}
+		//The search counters of all the processes are summed
+		search_stats_t total;
+		MPI_Reduce(&search_stats, &total, SEARCH_STATS_FIELDS, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+		if (completed)
+		{
+			//A lost first pass says nothing about which move loses least, so the move of the last iteration stands
+			if (solve_pass != 1 || score >= 0) best_move_loc = move;
+			evaluation = score;
+			fprintf(masterPtr, "%s %d: best move %d with an evaluation of %.2f after %.3f s\n", solve_pass == 0 ? "Depth" : solve_pass == 1 ? "Win/loss/draw" : "Exact",
+				depth, best_move_loc, score_in_discs(evaluation), MPI_Wtime() - search_start);
+			if (!options.tds) sort_root_moves(root_moves, root_scores, number_legal_moves);
+			last_search.depth = depth;
+			last_search.solve_pass = solve_pass;
+		}
+		//The effective branching factor is the growth in nodes from one iteration to the next
+		fprintf(masterPtr, "  nodes %ld (EBF %.2f), cutoffs %ld (%.0f%% on the first move, %ld on the table move, %ld on killers), re-searches %ld, table cutoffs %ld, stability cutoffs %ld, moves handed out %ld (%ld aborted, %ld narrowed), remote table hits %ld/%ld\n",
+			total.nodes, previous_nodes > 0 ? (double) total.nodes / previous_nodes : 0.0,
+			total.cutoffs, total.cutoffs > 0 ? 100.0 * total.first_cutoffs / total.cutoffs : 0.0, total.hash_cutoffs, total.killer_cutoffs,
+			total.researches, total.tt_cutoffs, total.stability_cutoffs, total.jobs, total.aborts, total.bounds, total.remote_hits, total.remote_probes);
+		previous_nodes = total.nodes;
+
+		//Another iteration is only started if it can change the answer and is likely to finish in time:
+		//the next iteration usually takes longer than all of the previous ones together
+		int can_change = number_legal_moves > 1 && depth < empties && depth < MAX_DEPTH;
+		if (solving)
+		{
+			//After a drawn first pass the score is already exact
+			can_change = number_legal_moves > 1 && (solve_pass == 0 || (solve_pass == 1 && evaluation != 0));
+		}
+		last_search.finished = completed && !can_change;
+		keep_searching = completed && can_change && MPI_Wtime() - search_start < (search_deadline - search_start) / 2;
+		MPI_Bcast(&keep_searching, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	}
+
+	memcpy(last_search.moves, root_moves, number_legal_moves * sizeof(int));
+	last_search.num_moves = number_legal_moves;
+	last_search.best_move = best_move_loc;
+	last_search.evaluation = evaluation;
+}
+
+int pondered_move_master(char *move, int my_colour, FILE *fp, FILE *masterPtr)
+{
+	//The search on the opponent's time may already have played the position the opponent left out to the end, or found
+	//a single legal move; FAILURE means there is still searching to do
+	if (!last_search.finished || last_search.colour != my_colour || memcmp(last_search.discs, discs, sizeof(discs)) != 0)
 	{
-		fprintf(masterPtr, "%d\t", receive_buffer[p]);
-	}
-	fprintf(masterPtr, "\n"); */
-
-	int *best_move = (int*)malloc(sizeof(int) * 2);
-	//random_strategy_2(receive_buffer, buffer_size, best_move);
-	search_for_best_move(receive_buffer, buffer_size, best_move, my_colour, masterPtr);
-	int *receive_counts = (int*)malloc(sizeof(int) * comm_sz);
-	int sum_2 = 0;
-	int *displs_rec = (int*)malloc(sizeof(int) * comm_sz);
-	int *receive_buffer_best_moves = (int*)malloc(sizeof(int) * 2 * comm_sz);
-	//fprintf(masterPtr, "The best move of the subset of moves is %d with an evaluation of %d\n", best_move[0], best_move[1]);
-	//The for loop fills an array receive_count with two
-	//It also fills the displacement array
-	//This is preparation of MPI_Gatherv function
-	for (int k = 0; k < comm_sz; k++)
+		return FAILURE;
+	}
+	fprintf(masterPtr, "Pondered move %d with an evaluation of %.2f\n", last_search.best_move, score_in_discs(last_search.evaluation));
+	play_move_master(last_search.best_move, move, my_colour, fp);
+	return SUCCESS;
+}
+
+/**
+ *  Rank 0 executes this code after sending its move:
+ *  --------------------------------------------------
+ *  Plays the reply the opponent is expected to make on the game state and searches the position it leaves with every process,
+ *  while a second thread waits for the referee's next command, which stops the search. The game state is then put back.
+ *  Returns 1 with the command read into cmd and opponent_move, or 0 if there was nothing to ponder and no command was read
+ */
+int ponder_master(char *cmd, char *opponent_move, int *cmd_status, int my_colour, FILE *fp, FILE *masterPtr)
+{
+	position_t now = position_of(my_colour);
+	if (bb_legal_moves(now.player, now.opponent) == 0 && bb_legal_moves(now.opponent, now.player) == 0)
+	{
+		return 0;
+	}
+	uint64_t game_state[3];
+	memcpy(game_state, discs, sizeof(discs));
+	int reply = predict_reply(my_colour);
+	if (reply != PASS) make_move(reply, opponent(my_colour, fp), fp);
+
+	//Nothing to search if we will have to pass, and the book answers the expected position without searching
+	position_t expected = position_of(my_colour);
+	int book_score;
+	if (bb_legal_moves(expected.player, expected.opponent) == 0 || book_move(&expected, &book_score) != PASS)
 	{
-		receive_counts[k] = 2;
-		displs_rec[k] = sum_2;
-		sum_2 = sum_2 + receive_counts[k];
-	}
-	//The best moves and their evuluations are loaded into receive_buffer_best_move
-	MPI_Gatherv(best_move, 2, MPI_INT, receive_buffer_best_moves, receive_counts, displs_rec, MPI_INT, 0, MPI_COMM_WORLD);
-	free(displs_rec);
-	free(receive_counts);
-	free(best_move);
-	int best_move_loc = -1;
-	int evaluation = -100;
-	//The for loop below determines the very best move out of all the best moves of the subset of moves. 
-	for (int l = 1; l < (2*comm_sz); l=l+2)
+		memcpy(discs, game_state, sizeof(discs));
+		return 0;
+	}
+
+	listener_t listener = {cmd, opponent_move, SUCCESS};
+	pthread_t listener_id;
+	search_interrupted = 0;
+	if (pthread_create(&listener_id, NULL, listen_to_referee, &listener) != 0)
 	{
-		fprintf(masterPtr, "A best move of the subset of moves is %d with an evaluation of %d\n", receive_buffer_best_moves[l-1], receive_buffer_best_moves[l]);
-		if (receive_buffer_best_moves[l] > evaluation)
-		{
-			evaluation = receive_buffer_best_moves[l];
-			best_move_loc = receive_buffer_best_moves[l-1];
-		}
+		memcpy(discs, game_state, sizeof(discs));
+		return 0;
 	}
+	fprintf(masterPtr, "Pondering on the reply %d\n", reply);
+	search_master(my_colour, PONDER_BUDGET, masterPtr);
+	pthread_join(listener_id, NULL);
+	search_interrupted = 0;
+	fprintf(masterPtr, "Pondered to depth %d: best move %d with an evaluation of %.2f\n", last_search.depth, last_search.best_move, score_in_discs(last_search.evaluation));
+	fflush(masterPtr);
 
-	free(receive_buffer_best_moves);
-	fprintf(masterPtr, "The very best move is %d with an evaluation of %d\n", best_move_loc, evaluation);
-	
+	memcpy(discs, game_state, sizeof(discs));
+	*cmd_status = listener.status;
+	return 1;
+}
 
-	int loc = best_move_loc;
-	//int loc = random_strategy(my_colour, fp);
+void *listen_to_referee(void *arg)
+{
+	//Only the socket is touched here; MPI stays with the main thread
+	listener_t *listener = (listener_t *) arg;
+	listener->status = comms_get_cmd(listener->cmd, listener->move);
+	search_interrupted = 1;
+	return NULL;
+}
 
-	if (loc == -1) {
-		strncpy(move, "pass\n", MOVEBUFSIZE);
-	} else {
-		/* apply move */
-		get_move_string(loc, move);
-		make_move(loc, my_colour, fp);
+int predict_reply(int my_colour)
+{
+	//The opponent is expected to play the best move the table remembers for the position after our move,
+	//which the last search went through; failing that its first legal move
+	position_t pos = position_of(opponent_1(my_colour));
+	uint64_t moves = bb_legal_moves(pos.player, pos.opponent);
+	tt_entry_t entry;
+	if (moves == 0)
+	{
+		return PASS;
+	}
+	if (tt_probe(pos.key, &entry) && entry.move != PASS && (moves & SQUARE_BIT(entry.move)))
+	{
+		return entry.move;
 	}
+	return bb_first_square(moves);
 }
 
 void apply_opp_move(char *move, int my_colour, FILE *fp) {
@@ -447,69 +708,19 @@ void apply_opp_move(char *move, int my_colour, FILE *fp) {
 
 void game_over() {
 	free_board();
+	tt_free();
+	search_free();
+	scheduler_free();
+	tds_free();
+	dtt_free();
+	eval_free();
+	book_close();
 	MPI_Finalize();
 }
 
-void get_move_string(int loc, char *ms) {
-	int row, col, new_loc;
-	new_loc = loc - (9 + 2 * (loc / 10));
-	row = new_loc / 8;
-	col = new_loc % 8;
-	ms[0] = row + '0';
-	ms[1] = col + '0';
-	ms[2] = '\n';
-	ms[3] = 0;
-}
-
-int get_loc(char* movestring) {
-	int row, col;
-	/* movestring of form "xy", x = row and y = column */ 
-	row = movestring[0] - '0'; 
-	col = movestring[1] - '0'; 
-	return (10 * (row + 1)) + col + 1;
-}
-
 void legal_moves(int player, int *moves, FILE *fp) {
-	int move, i;
-	moves[0] = 0;
-	i = 0;
-	for (move = 11; move <= 88; move++)
-		if (legalp(move, player, fp)) {
-		i++;
-		moves[i] = move;
-	}
-	moves[0] = i;
-}
-
-int legalp(int move, int player, FILE *fp) {
-	int i;
-	if (!validp(move)) return 0;
-	if (board[move] == EMPTY) {
-		i = 0;
-		while (i <= 7 && !would_flip(move, ALLDIRECTIONS[i], player, fp)) i++;
-		if (i == 8) return 0; else return 1;
-	}
-	else return 0;
-}
-
-int validp(int move) {
-	if ((move >= 11) && (move <= 88) && (move%10 >= 1) && (move%10 <= 8))
-		return 1;
-	else return 0;
-}
-
-int would_flip(int move, int dir, int player, FILE *fp) {
-	int c;
-	c = move + dir;
-	if (board[c] == opponent(player, fp))
-		return find_bracket_piece(c+dir, dir, player, fp);
-	else return 0;
-}
-
-int find_bracket_piece(int square, int dir, int player, FILE *fp) {
-	while (board[square] == opponent(player, fp)) square = square + dir;
-	if (board[square] == player) return square;
-	else return 0;
+	position_t pos = position_of(player);
+	moves[0] = bb_to_list(bb_legal_moves(pos.player, pos.opponent), moves + 1);
 }
 
 int opponent(int player, FILE *fp) {
@@ -547,25 +758,42 @@ void random_strategy_2(int *moves, int buffer_size, int* best_move) {
 }
 
 void make_move(int move, int player, FILE *fp) {
-	int i;
-	board[move] = player;
-	for (i = 0; i <= 7; i++) make_flips(move, ALLDIRECTIONS[i], player, fp);
+	position_t pos = position_of(player);
+	uint64_t flips = bb_flips(move, pos.player, pos.opponent);
+	discs[player] |= flips | SQUARE_BIT(move);
+	discs[opponent(player, fp)] &= ~flips;
+}
+
+/**
+ * Returns the game state as seen by player, for the search and move generator
+ */
+position_t position_of(int player) {
+	position_t pos;
+	pos.player = discs[player];
+	pos.opponent = discs[opponent_1(player)];
+	bb_hash_position(&pos);
+	return pos;
 }
 
-void make_flips(int move, int dir, int player, FILE *fp) {
-	int bracketer, c;
-	bracketer = would_flip(move, dir, player, fp);
-	if (bracketer) {
-		c = move + dir;
-		do {
-			board[c] = player;
-			c = c + dir;
-		} while (c != bracketer);
+/**
+ * Refreshes the mailbox view of the game state that print_board works from
+ */
+void update_mailbox() {
+	int row, col;
+	for (row = 0; row < 8; row++) {
+		for (col = 0; col < 8; col++) {
+			uint64_t bit = SQUARE_BIT(SQUARE(row, col));
+			int sq = (10 * (row + 1)) + col + 1;
+			if (discs[BLACK] & bit) board[sq] = BLACK;
+			else if (discs[WHITE] & bit) board[sq] = WHITE;
+			else board[sq] = EMPTY;
+		}
 	}
 }
 
 void print_board(FILE *fp) {
 	int row, col;
+	update_mailbox();
 	fprintf(fp, "   1 2 3 4 5 6 7 8 [%c=%d %c=%d]\n",
 		nameof(BLACK), count(BLACK, board), nameof(WHITE), count(WHITE, board));
 	for (row = 1; row <= 8; row++) {
@@ -688,260 +916,28 @@ FILE* open_logfile_2(int colour)
 	return filePtr;
 }
 
-void search_for_best_move(int *moves, int buffer_size, int *best_move, int player, FILE *ptr)
-{
-	//This places the best move and its evaluation into the best_move array
-
-	if (buffer_size == 0)
-	{
-		best_move[0] = -1;
-		best_move[1] = -100;
-		return;
-	}
-
-	//A local copy of the board is made
-	int *local_board = (int*)malloc(sizeof(int) * 100);		
-	for (int a = 0; a < 100; a++)
-	{
-	local_board[a] = board[a];
-	}
-
-
-	best_move[0] = -1;
-	best_move[1] = -100;
-	int max = -100;
-	int num = 0;
-	int evaluation;
-
-	for (int i = 0; i < buffer_size; i++)
-	{	
-		//Every legal move in the buffer of the process is evaluated and the one with the highest evaluation is placed in the best_move array
-		evaluation = minimax(local_board, moves[i], 6, player, player, -1000, 1000, ptr);
-		//fprintf(ptr, "One of the moves in the buffer is %d and it has an evaluation of %d\n", moves[i], evaluation);
-		if (evaluation > max)
-		{
-			max = evaluation;
-			num = i;
-		}	
-	}
-	fprintf(ptr, "\n");
-	best_move[0] = moves[num];
-	best_move[1] = max; 
-	free(local_board);
-}
-
-int minimax(int *local_board, int move, int depth, int maximizing_player, int current_player, int alpha, int beta, FILE *ptr)
+void sort_root_moves(int *moves, int *scores, int num_moves)
 {
-
-	int score = 0;
-
-	if (move == 0)
-	{
-		return 0;
-	}
-
-	//Uses the move the change the state of the board and loads the new state into local_board
-	make_modified_move(move, local_board, current_player);//Changes the local_board appropriately
-	current_player = opponent_1(current_player);//Changes the current player
-	int *moves = (int*)malloc(sizeof(int) * LEGALMOVSBUFSIZE);
-	legal_moves_1(current_player, moves, local_board);//Determines the legal moves for the new board and current player
-	int total_moves = moves[0];
-
-	if (depth == 0 || total_moves == 0)
-	{
-	//Performs static evuluation of the board
-	//It calculates the static evaluation by subtracting the number of squares of the minimizing players from the number of squares of the maximizing player
-	score = static_evaluation(local_board, maximizing_player, ptr);
-	return score;
-	}
-
-	//A copy of the local board is made
-	int *temp_board = (int*)malloc(sizeof(int) * 100);
-	for (int i = 0; i < 100; i++)
-	{
-		temp_board[i] = local_board[i];
-	}
-
-	if (current_player == maximizing_player)
+	//Sorts the root moves best score first, so the next iteration hands out the most promising moves first.
+	//Insertion sort: there are never more than a few dozen moves and the order barely changes between iterations
+	for (int i = 1; i < num_moves; i++)
 	{
-		int maxEval = -100;
-		int eval;
-		for (int j = 1; j <= total_moves; j++)
+		int move = moves[i];
+		int score = scores[i];
+		int j = i;
+		while (j > 0 && scores[j-1] < score)
 		{
-			eval = minimax(temp_board, moves[j], depth-1, maximizing_player, current_player, alpha, beta, ptr);
-			if (eval > maxEval)
-			{
-				maxEval = eval;
-			}
-			//Alpha beta pruning
-			if (alpha < score)
-			{
-				alpha = score;
-			}
-			if (beta <= alpha)
-			{
-				break;
-			}
-			for (int t = 0; t < 100; t++)
-			{
-				temp_board[t] = local_board[t];
-			}
-		}
-		free(temp_board);
-		free(moves);
-		return maxEval;
-	}
-	else
-	{
-		int minEval = 100;
-		int eval;
-		for (int k = 1; k <= total_moves; k++)
-		{
-			eval = minimax(temp_board, moves[k], depth-1, maximizing_player, current_player, alpha, beta, ptr);
-			if (eval < minEval)
-			{
-				minEval = eval;
-			}
-			if (score < beta)
-			{
-				beta = score;
-			}
-			if (beta <= alpha)
-			{
-				break;
-			}
-			for (int b = 0; b < 100; b++)
-			{
-				temp_board[b] = local_board[b];
-			}
+			moves[j] = moves[j-1];
+			scores[j] = scores[j-1];
+			j--;
 		}
-		free(temp_board);
-		free(moves);
-		return minEval;
-	}
-
-	
-}
-
-void make_modified_move(int move, int *board_modified, int player)
-{
-	board_modified[move] = player;
-	for (int i = 0; i <= 7; i++)
-	{
-		make_flips_1(move, ALLDIRECTIONS[i], player, board_modified);
+		moves[j] = move;
+		scores[j] = score;
 	}
 }
 
-void make_flips_1(int move, int dir, int player, int *board_modified) {
-	int bracketer, c;
-
-	bracketer = would_flip_1(move, dir, player, board_modified);
-	if (bracketer) {
-		c = move + dir;
-		do {
-			board_modified[c] = player;
-			c = c + dir;
-		} while (c != bracketer);
-	}
-}
-
-int would_flip_1(int move, int dir, int player, int *board_modified) {
-	int c;
-	c = move + dir;
-	if (board_modified[c] == opponent_1(player))
-		return find_bracket_piece_1(c+dir, dir, player, board_modified);
-	else return 0;
-}
-
 int opponent_1(int player) {
 	if (player == BLACK) return WHITE;
 	if (player == WHITE) return BLACK;
 	return EMPTY;
 }
-
-int find_bracket_piece_1(int square, int dir, int player, int *board_modified) {
-	while (board_modified[square] == opponent_1(player)) square = square + dir;
-	if (board_modified[square] == player) return square;
-	else return 0;
-}
-
-void legal_moves_1(int player, int *moves, int *board_modified) {
-	int move, i;
-	moves[0] = 0;
-	i = 0;
-	for (move = 11; move <= 88; move++)
-		if (legalp_1(move, player, board_modified)) {
-		i++;
-		moves[i] = move;
-	}
-	moves[0] = i;
-}
-
-int legalp_1(int move, int player, int* board_modified) {
-	int i;
-	if (!validp(move)) return 0;
-	if (board_modified[move] == EMPTY) {
-		i = 0;
-		while (i <= 7 && !would_flip_1(move, ALLDIRECTIONS[i], player, board_modified)) i++;
-		if (i == 8) return 0; else return 1;
-	}
-	else return 0;
-}
-
-int static_evaluation(int *board_modified, int player_type, FILE *ptr)
-{
-	int white = 0;
-	int black = 0;
-	int blank = 0;
-	int statEval1 = 0;
-	int statEval2 = 0;
-
-	for (int i = 11; i <=88; i++)
-	{
-		if ((i%10 !=0 ) && (i%10 != 9))
-		{
-			if (board_modified[i] == WHITE)
-			{
-				white++;
-			}
-			else if (board_modified[i] == BLACK)
-			{
-				black++;
-			}
-			else if (board_modified[i] == EMPTY)
-			{
-				blank++;
-			}
-		}
-	}
-
-	if (player_type == WHITE)
-	{
-		statEval1 = white - black;
-		//fprintf(ptr, "The player type is white and the static evaluation is %d\n", statEval1);
-		return statEval1;
-	}
-	else if (player_type == BLACK)
-	{
-		statEval2 = black - white;
-		//fprintf(ptr, "The player type is black and the static evaluation is %d\n", statEval2);
-		return statEval2;
-	}
-	else
-	{
-		return blank;
-	}
-}
-
-void print_board_1(FILE *fp, int *local_board) {
-	int row, col;
-	fprintf(fp, "   1 2 3 4 5 6 7 8 [%c=%d %c=%d]\n",
-		nameof(BLACK), count(BLACK, local_board), nameof(WHITE), count(WHITE, local_board));
-	for (row = 1; row <= 8; row++) {
-		fprintf(fp, "%d  ", row);
-		for (col = 1; col <= 8; col++)
-			fprintf(fp, "%c ", nameof(local_board[col + (10 * row)]));
-		fprintf(fp, "\n");
-	}
-	fflush(fp);
-}
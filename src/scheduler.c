@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <mpi.h>
+#include "comms.h"
+#include "search.h"
+#include "scheduler.h"
+
+/*
+ * Young Brothers Wait
+ * -------------------
+ * Every rank searches with the same pvs. Once the eldest move of a node
+ * that is deep enough has been searched, the node is split: its remaining
+ * moves may be given to other ranks. Idle ranks ask a random rank for work
+ * (TAG_STEAL), which hands out the next move of its shallowest split node
+ * the next time it polls. The helper searches the move with the node's
+ * window as it was then and sends the score back (TAG_RESULT). Whenever
+ * the node's alpha rises after that without cutting it off, the helpers
+ * still busy with its moves get the narrower window (TAG_BOUND), so their
+ * subtrees prune against the best score found so far. If a result cuts
+ * the node off, the owner abandons the node, tells the helpers still busy
+ * with its moves to stop (TAG_ABORT) and waits for their answers, so
+ * every move handed out is always answered before its node returns.
+ *
+ * Rank 0 searches the root. When it is done every handed out move has
+ * been answered, so all workers are idle; TAG_DONE sends them to the end
+ * of the iteration, where a non-blocking barrier soaks up the last steal
+ * requests before the collectives that follow.
+ */
+
+/* A move handed out to another rank */
+typedef struct {
+	int64_t id;		/* unique per owner for the whole game, so late aborts can be told apart */
+	int64_t player;		/* the position after the move */
+	int64_t opponent;
+	int64_t ply;
+	int64_t depth;
+	int64_t alpha;		/* window of the node it was taken from */
+	int64_t beta;
+} job_t;
+
+typedef struct {
+	int64_t id;
+	int64_t score;
+	int64_t completed;
+} result_t;
+
+/* The window of the node a move was handed out from, once it has narrowed */
+typedef struct {
+	int64_t id;
+	int64_t alpha;
+	int64_t beta;
+} bound_t;
+
+#define JOB_FIELDS ((int) (sizeof(job_t) / sizeof(int64_t)))
+#define RESULT_FIELDS ((int) (sizeof(result_t) / sizeof(int64_t)))
+#define BOUND_FIELDS ((int) (sizeof(bound_t) / sizeof(int64_t)))
+
+/* What a helper rank is searching for this rank */
+typedef struct {
+	int64_t id;		/* -1: nothing */
+	int ply;		/* node the move came from */
+	int index;		/* index of the move in the node */
+} loan_t;
+
+int scheduler_ranks = 1;
+/* Set while an iteration is scheduled here; other searches (TDS) leave pvs alone */
+int scheduler_active = 0;
+static int my_rank;
+static loan_t *loans = NULL;	/* loans[rank] */
+static int64_t next_job_id = 0;
+static unsigned int victim_seed;
+
+/* The move this rank is searching for another one, if any */
+static struct {
+	int owner;
+	int64_t id;
+	int ply;
+} current_job = {-1, -1, 0};
+
+/**
+ * Sets up the bookkeeping for the other ranks
+ */
+int scheduler_init(void) {
+	int rank;
+
+	MPI_Comm_size(MPI_COMM_WORLD, &scheduler_ranks);
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	loans = malloc(scheduler_ranks * sizeof(loan_t));
+	if (loans == NULL) return FAILURE;
+	for (rank = 0; rank < scheduler_ranks; rank++) loans[rank].id = -1;
+	victim_seed = 12345u + my_rank;
+	return SUCCESS;
+}
+
+void scheduler_free(void) {
+	free(loans);
+	loans = NULL;
+}
+
+/**
+ * Answers a steal request with the next move of the shallowest split node,
+ * which is where the largest subtrees are, or with no work
+ */
+static void hand_out_move(search_thread_t *thread, int thief) {
+	job_t job = {-1, 0, 0, 0, 0, 0, 0};
+	int ply;
+
+	/* an idle rank has nothing to hand out */
+	for (ply = 0; thread != NULL && ply < MAX_PLY && ply <= thread->stop_ply && !search_aborted; ply++) {
+		search_frame_t *frame = &thread->stack[ply];
+		position_t child;
+		int i;
+
+		if (!frame->split || frame->next >= frame->num_moves || frame->alpha >= frame->beta) continue;
+
+		i = frame->next++;
+		child = frame->pos;
+		bb_make_move(&child, frame->moves[i], bb_flips(frame->moves[i], child.player, child.opponent));
+		job.id = next_job_id++;
+		job.player = (int64_t) child.player;
+		job.opponent = (int64_t) child.opponent;
+		job.ply = ply + 1;
+		job.depth = frame->depth - 1;
+		job.alpha = frame->alpha;
+		job.beta = frame->beta;
+		loans[thief].id = job.id;
+		loans[thief].ply = ply;
+		loans[thief].index = i;
+		frame->helpers++;
+		thread->stats.jobs++;
+		break;
+	}
+	MPI_Send(&job, JOB_FIELDS, MPI_INT64_T, thief, TAG_JOB, MPI_COMM_WORLD);
+}
+
+/**
+ * Takes in the score of a move searched by another rank
+ */
+static void take_result(search_thread_t *thread, int helper, const result_t *result) {
+	search_frame_t *frame = &thread->stack[loans[helper].ply];
+	int ply = loans[helper].ply;
+
+	loans[helper].id = -1;
+	frame->helpers--;
+	if (!result->completed) {
+		/* unless the node was given up anyway, it can no longer be scored */
+		if (frame->alpha < frame->beta && ply <= thread->stop_ply) search_aborted = 1;
+		return;
+	}
+	search_record(thread, frame, loans[helper].index, (int) result->score);
+	/* a cutoff abandons whatever this rank is searching below the node */
+	if (frame->alpha >= frame->beta && ply < thread->stop_ply) thread->stop_ply = ply;
+}
+
+/**
+ * Sends the window of the node at ply to every rank busy with one of its moves
+ */
+void scheduler_share_bound(search_thread_t *thread, int ply) {
+	search_frame_t *frame = &thread->stack[ply];
+	bound_t bound;
+	int rank;
+
+	bound.alpha = frame->alpha;
+	bound.beta = frame->beta;
+	for (rank = 0; rank < scheduler_ranks; rank++) {
+		if (loans[rank].id >= 0 && loans[rank].ply == ply) {
+			bound.id = loans[rank].id;
+			MPI_Send(&bound, BOUND_FIELDS, MPI_INT64_T, rank, TAG_BOUND, MPI_COMM_WORLD);
+			thread->stats.bounds++;
+		}
+	}
+}
+
+/**
+ * Handles a message that may arrive while this rank is searching
+ */
+static void handle_message(search_thread_t *thread, const MPI_Status *status) {
+	result_t result;
+	bound_t bound;
+	int64_t id;
+
+	switch (status->MPI_TAG) {
+	case TAG_STEAL:
+		MPI_Recv(NULL, 0, MPI_INT, status->MPI_SOURCE, TAG_STEAL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		hand_out_move(thread, status->MPI_SOURCE);
+		break;
+	case TAG_RESULT:
+		MPI_Recv(&result, RESULT_FIELDS, MPI_INT64_T, status->MPI_SOURCE, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		take_result(thread, status->MPI_SOURCE, &result);
+		break;
+	case TAG_ABORT:
+		MPI_Recv(&id, 1, MPI_INT64_T, status->MPI_SOURCE, TAG_ABORT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		/* an abort can overtake nothing but trail the result it was meant to stop; those are ignored */
+		if (status->MPI_SOURCE == current_job.owner && id == current_job.id && current_job.ply - 1 < thread->stop_ply) {
+			thread->stop_ply = current_job.ply - 1;
+		}
+		break;
+	case TAG_BOUND:
+		MPI_Recv(&bound, BOUND_FIELDS, MPI_INT64_T, status->MPI_SOURCE, TAG_BOUND, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		/* like aborts, bounds can trail the result of their move and are then ignored */
+		if (status->MPI_SOURCE == current_job.owner && bound.id == current_job.id) {
+			search_narrow(thread, current_job.ply - 1, (int) bound.alpha, (int) bound.beta);
+		}
+		break;
+	}
+}
+
+/**
+ * Called from the search every so often: answers the messages that have arrived
+ */
+void scheduler_poll(search_thread_t *thread) {
+	int flag;
+	MPI_Status status;
+
+	if (!scheduler_active) return;
+	for (;;) {
+		MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+		if (!flag) return;
+		handle_message(thread, &status);
+	}
+}
+
+/**
+ * Waits until every move of the node at ply that went to another rank has
+ * been answered. If the node has been cut off or given up, the helpers are
+ * told to stop first
+ */
+void wait_for_helpers(search_thread_t *thread, int ply) {
+	search_frame_t *frame = &thread->stack[ply];
+	int aborted = 0;
+	int rank;
+	MPI_Status status;
+
+	while (frame->helpers > 0) {
+		if (!aborted && (frame->alpha >= frame->beta || search_aborted || ply > thread->stop_ply)) {
+			for (rank = 0; rank < scheduler_ranks; rank++) {
+				if (loans[rank].id >= 0 && loans[rank].ply == ply) {
+					MPI_Send(&loans[rank].id, 1, MPI_INT64_T, rank, TAG_ABORT, MPI_COMM_WORLD);
+					thread->stats.aborts++;
+				}
+			}
+			aborted = 1;
+		}
+		MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+		handle_message(thread, &status);
+	}
+}
+
+/**
+ * Answers steal requests with no work until every rank has reached the end
+ * of the iteration; by then no request is left in flight
+ */
+static void finish_iteration(search_thread_t *thread) {
+	MPI_Request barrier;
+	MPI_Status status;
+	int done = 0;
+	int flag;
+
+	MPI_Ibarrier(MPI_COMM_WORLD, &barrier);
+	while (!done) {
+		MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+		if (flag) handle_message(thread, &status);
+		MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+	}
+}
+
+/**
+ * Rank 0: searches one iteration of the root moves of pos, in the order
+ * given, together with the workers.
+ * Returns 1 if the iteration completed before the deadline, 0 if it was cut off
+ */
+int schedule_root_master(const position_t *pos, const int *moves, int num_moves, int depth, int alpha, int beta, int *scores, int *best_move, int *best_score) {
+	int completed, rank;
+
+	scheduler_active = (scheduler_ranks > 1);
+	completed = search_root(pos, moves, num_moves, depth, alpha, beta, scores, best_move, best_score);
+	scheduler_active = 0;
+
+	for (rank = 1; rank < scheduler_ranks; rank++) MPI_Send(NULL, 0, MPI_INT, rank, TAG_DONE, MPI_COMM_WORLD);
+	finish_iteration(NULL);
+	return completed;
+}
+
+/**
+ * Searches a move handed out by owner and sends the score back
+ */
+static void run_job(int owner, const job_t *job) {
+	result_t result;
+	position_t pos;
+	int score;
+
+	pos.player = (uint64_t) job->player;
+	pos.opponent = (uint64_t) job->opponent;
+	bb_hash_position(&pos);
+
+	current_job.owner = owner;
+	current_job.id = job->id;
+	current_job.ply = (int) job->ply;
+	result.id = job->id;
+	result.completed = search_job(&pos, (int) job->ply, (int) job->depth, (int) job->alpha, (int) job->beta, &score);
+	result.score = score;
+	current_job.owner = -1;
+	MPI_Send(&result, RESULT_FIELDS, MPI_INT64_T, owner, TAG_RESULT, MPI_COMM_WORLD);
+}
+
+/**
+ * Worker ranks: asks random ranks for moves to search until rank 0 says the
+ * iteration is over
+ */
+void schedule_root_worker(void) {
+	job_t job;
+	MPI_Status status;
+	int stealing = 0;
+	int done = 0;
+
+	scheduler_active = 1;
+	while (!done || stealing) {
+		if (!done && !stealing) {
+			int victim = rand_r(&victim_seed) % (scheduler_ranks - 1);
+			if (victim >= my_rank) victim++;
+			MPI_Send(NULL, 0, MPI_INT, victim, TAG_STEAL, MPI_COMM_WORLD);
+			stealing = 1;
+		}
+		MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+		if (status.MPI_TAG == TAG_JOB) {
+			MPI_Recv(&job, JOB_FIELDS, MPI_INT64_T, status.MPI_SOURCE, TAG_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			stealing = 0;
+			if (job.id >= 0) run_job(status.MPI_SOURCE, &job);
+		} else if (status.MPI_TAG == TAG_DONE) {
+			MPI_Recv(NULL, 0, MPI_INT, 0, TAG_DONE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			done = 1;
+		} else {
+			handle_message(NULL, &status);
+		}
+	}
+	finish_iteration(NULL);
+	scheduler_active = 0;
+}
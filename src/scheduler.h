@@ -0,0 +1,30 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "bitboard.h"
+#include "search.h"
+#include "options.h"
+
+/* Message tags of the distributed search */
+#define TAG_STEAL 1	/* idle rank -> any rank: asks for a move to search */
+#define TAG_JOB 2	/* answer to TAG_STEAL: a move to search, or none */
+#define TAG_RESULT 3	/* helper -> owner of the node: score of the move it was given */
+#define TAG_ABORT 4	/* owner -> helper: the node was cut off, stop searching the move */
+#define TAG_DONE 5	/* rank 0 -> workers: the iteration is over */
+#define TAG_BOUND 6	/* owner -> helper: the node's window has narrowed, search the move against the new one */
+
+/* Nodes are only split if they are this deep, so that a handed out move is worth the messages */
+#define scheduler_can_split(depth) (scheduler_active && (depth) >= options.split_depth)
+
+extern int scheduler_ranks;
+extern int scheduler_active;
+
+int scheduler_init(void);
+void scheduler_free(void);
+void scheduler_poll(search_thread_t *thread);
+void wait_for_helpers(search_thread_t *thread, int ply);
+void scheduler_share_bound(search_thread_t *thread, int ply);
+int schedule_root_master(const position_t *pos, const int *moves, int num_moves, int depth, int alpha, int beta, int *scores, int *best_move, int *best_score);
+void schedule_root_worker(void);
+
+#endif
@@ -0,0 +1,664 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <mpi.h>
+#include "bitboard.h"
+#include "hash.h"
+#include "dtt.h"
+#include "comms.h"
+#include "search.h"
+#include "scheduler.h"
+#include "options.h"
+#include "endgame.h"
+#include "eval.h"
+
+search_stats_t search_stats;
+
+/*
+ * Lazy SMP: threads[0] is the main thread, the only one that talks to the
+ * other ranks. Whenever it searches, the helper threads search the same
+ * position on their own, a ply deeper every other thread and with the
+ * moves at the top in a different order, and only share what they find
+ * through the transposition table.
+ */
+static search_thread_t *threads = NULL;
+static search_thread_t *main_thread = NULL;
+static int num_threads = 0;
+static pthread_t *helper_ids = NULL;
+
+/* What the helper threads are asked to search, guarded by helper_lock */
+static pthread_mutex_t helper_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t helper_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t helper_idle = PTHREAD_COND_INITIALIZER;
+static struct {
+	position_t pos;
+	int ply;
+	int depth;
+	int generation;		/* bumped for every new search, -1 to shut the helpers down */
+	int busy;		/* helpers still searching the current one */
+} helper_work;
+
+/* Every rank stops searching at its own copy of the deadline, set when the search starts */
+double search_deadline;
+volatile int search_aborted;
+/* Set from another thread to end the search before the deadline, as when the referee speaks while pondering */
+volatile int search_interrupted = 0;
+
+/* The root of the last search and the discs on its board, see start_new_root */
+static uint64_t root_key = 0;
+static int root_discs = 0;
+
+static void *helper_main(void *arg);
+
+/*
+ * Move ordering: the move the transposition table remembers goes first,
+ * then the killer moves of the ply, then the rest by their history score.
+ * Far enough from the leaves the rest are sorted by how few replies they
+ * leave the opponent first, with the history score breaking ties. When the
+ * game is being played out to the end that is always done, and moves into
+ * quadrants with an odd number of empty squares are preferred among equals
+ * (see endgame.c).
+ */
+#define ORDER_HASH (1 << 29)
+#define ORDER_KILLER (1 << 28)
+#define HISTORY_LIMIT (1 << 16)		/* history scores are halved when one gets this big */
+#define MOBILITY_WEIGHT HISTORY_LIMIT
+
+static void clear_killers(search_thread_t *thread) {
+	int ply;
+
+	for (ply = 0; ply < MAX_PLY; ply++) {
+		thread->stack[ply].killers[0] = PASS;
+		thread->stack[ply].killers[1] = PASS;
+	}
+}
+
+/**
+ * Allocates the search stacks of this process and starts its helper threads
+ */
+int search_init(void) {
+	int i;
+
+	num_threads = (options.threads > 0) ? options.threads : 1;
+	threads = calloc(num_threads, sizeof(search_thread_t));
+	helper_ids = calloc(num_threads, sizeof(pthread_t));
+	if (threads == NULL || helper_ids == NULL) return FAILURE;
+	main_thread = &threads[0];
+	helper_work.generation = 0;
+	helper_work.busy = 0;
+	for (i = 0; i < num_threads; i++) {
+		threads[i].id = i;
+		clear_killers(&threads[i]);
+	}
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&helper_ids[i], NULL, helper_main, &threads[i]) != 0) {
+			/* search with the threads that did start */
+			num_threads = i;
+			break;
+		}
+	}
+	return SUCCESS;
+}
+
+void search_free(void) {
+	int i;
+
+	if (threads == NULL) return;
+	pthread_mutex_lock(&helper_lock);
+	helper_work.generation = -1;
+	pthread_cond_broadcast(&helper_start);
+	pthread_mutex_unlock(&helper_lock);
+	for (i = 1; i < num_threads; i++) pthread_join(helper_ids[i], NULL);
+
+	free(threads);
+	free(helper_ids);
+	threads = NULL;
+	main_thread = NULL;
+	helper_ids = NULL;
+}
+
+/**
+ * Starts the clock for the next search on this process
+ */
+void start_search_clock(double budget) {
+	search_deadline = MPI_Wtime() + budget;
+	search_aborted = 0;
+}
+
+/**
+ * Carries what the searches so far learnt over to the next one, from root.
+ * The table only ages (see tt_new_search).
+ * The killers move up as many plies as moves were played since the last
+ * root, so that they stay with the same depth of the game, and the history
+ * scores are halved, so that those of earlier moves fade out. A root with
+ * fewer discs is a new game, which starts without killers.
+ * Searching the same root again, as after a correctly predicted reply, carries
+ * on with everything as it is, so the entries the last search left are not the
+ * first to be replaced
+ */
+void start_new_root(const position_t *root) {
+	int discs = bb_count(root->player | root->opponent);
+	int shift = discs - root_discs;
+	int i, ply, sq;
+
+	if (root->key == root_key && shift == 0) return;
+	tt_new_search();
+	for (i = 0; i < num_threads; i++) {
+		search_thread_t *thread = &threads[i];
+
+		if (shift < 0) {
+			clear_killers(thread);
+			continue;
+		}
+		if (shift == 0) continue;
+		for (ply = 0; ply < MAX_PLY; ply++) {
+			search_frame_t *frame = &thread->stack[ply];
+
+			frame->killers[0] = (ply + shift < MAX_PLY) ? thread->stack[ply + shift].killers[0] : PASS;
+			frame->killers[1] = (ply + shift < MAX_PLY) ? thread->stack[ply + shift].killers[1] : PASS;
+		}
+		for (sq = 0; sq < NUM_SQUARES; sq++) thread->history[sq] /= 2;
+	}
+	root_key = root->key;
+	root_discs = discs;
+}
+
+void reset_search_stats(void) {
+	memset(&search_stats, 0, sizeof(search_stats));
+}
+
+/**
+ * Adds the counters of every thread to search_stats and clears them
+ */
+static void collect_search_stats(void) {
+	long *total = (long *) &search_stats;
+	int i, j;
+
+	for (i = 0; i < num_threads; i++) {
+		long *counts = (long *) &threads[i].stats;
+		for (j = 0; j < SEARCH_STATS_FIELDS; j++) total[j] += counts[j];
+		memset(&threads[i].stats, 0, sizeof(search_stats_t));
+		threads[i].next_poll = 0;
+	}
+}
+
+/**
+ * Score of a finished game for the side to move
+ */
+int final_score(const position_t *pos) {
+	return (bb_count(pos->player) - bb_count(pos->opponent)) * SCORE_DISC;
+}
+
+/**
+ * Whether the node at ply has to give up: the deadline has passed or an
+ * ancestor has been cut off by a result from another rank
+ */
+static int stopped(const search_thread_t *thread, int ply) {
+	return search_aborted || ply > thread->stop_ply;
+}
+
+/**
+ * Ends the search once the deadline has passed or someone has asked it to stop
+ */
+static void check_clock(void) {
+	if (MPI_Wtime() > search_deadline || search_interrupted) search_aborted = 1;
+}
+
+/**
+ * Makes sq a killer move of the frame's ply and raises its history score,
+ * more so the deeper the node it cut off
+ */
+static void remember_cutoff(search_thread_t *thread, search_frame_t *frame, int sq) {
+	int i;
+
+	if (frame->killers[0] != sq) {
+		frame->killers[1] = frame->killers[0];
+		frame->killers[0] = sq;
+	}
+	thread->history[sq] += frame->depth * frame->depth;
+	if (thread->history[sq] >= HISTORY_LIMIT) {
+		for (i = 0; i < NUM_SQUARES; i++) thread->history[i] /= 2;
+	}
+}
+
+/**
+ * Sorts the moves of the node set up in the frame at ply into the order
+ * they are to be searched in
+ */
+static void order_moves(search_thread_t *thread, int ply) {
+	search_frame_t *frame = &thread->stack[ply];
+	const position_t *pos = &thread->pos;
+	uint64_t empty = ~(pos->player | pos->opponent);
+	int solving = frame->depth >= bb_count(empty);
+	uint64_t odd = solving ? endgame_odd_regions(empty) : 0;
+	int keys[MAX_MOVES];
+	int i, j;
+
+	for (i = 0; i < frame->num_moves; i++) {
+		int sq = frame->moves[i];
+
+		if (sq == frame->hash_move) {
+			keys[i] = ORDER_HASH;
+		} else if (sq == frame->killers[0]) {
+			keys[i] = ORDER_KILLER;
+		} else if (sq == frame->killers[1]) {
+			keys[i] = ORDER_KILLER - 1;
+		} else if (solving) {
+			uint64_t flips = bb_flips(sq, pos->player, pos->opponent);
+			int replies = bb_count(bb_legal_moves(pos->opponent & ~flips, pos->player | flips | SQUARE_BIT(sq)));
+
+			keys[i] = (NUM_SQUARES - replies) * MOBILITY_WEIGHT + thread->history[sq] / 2;
+			if (SQUARE_BIT(sq) & odd) keys[i] += MOBILITY_WEIGHT / 2;
+		} else {
+			keys[i] = thread->history[sq];
+			if (frame->depth >= options.sort_depth) {
+				uint64_t flips = bb_flips(sq, pos->player, pos->opponent);
+				int replies = bb_count(bb_legal_moves(pos->opponent & ~flips, pos->player | flips | SQUARE_BIT(sq)));
+
+				keys[i] += (NUM_SQUARES - replies) * MOBILITY_WEIGHT;
+			}
+		}
+	}
+
+	/* insertion sort: there are rarely more than a dozen moves */
+	for (i = 1; i < frame->num_moves; i++) {
+		int key = keys[i], sq = frame->moves[i];
+
+		for (j = i; j > 0 && keys[j - 1] < key; j--) {
+			keys[j] = keys[j - 1];
+			frame->moves[j] = frame->moves[j - 1];
+		}
+		keys[j] = key;
+		frame->moves[j] = sq;
+	}
+}
+
+/**
+ * Takes in the score of move i of a node, whether it was searched here or on another rank
+ */
+void search_record(search_thread_t *thread, search_frame_t *frame, int i, int score) {
+	frame->scores[i] = score;
+	if (score > frame->best_score) {
+		frame->best_score = score;
+		frame->best_move = frame->moves[i];
+		if (score > frame->alpha) {
+			frame->alpha = score;
+			/* the moves out on other ranks can prune against the better bound too */
+			if (frame->helpers > 0 && frame->alpha < frame->beta) scheduler_share_bound(thread, (int) (frame - thread->stack));
+		}
+		if (frame->alpha >= frame->beta) {
+			thread->stats.cutoffs++;
+			if (i == 0) thread->stats.first_cutoffs++;
+			if (frame->moves[i] == frame->hash_move) {
+				thread->stats.hash_cutoffs++;
+			} else if (frame->moves[i] == frame->killers[0] || frame->moves[i] == frame->killers[1]) {
+				thread->stats.killer_cutoffs++;
+			}
+			remember_cutoff(thread, frame, frame->moves[i]);
+		}
+	}
+}
+
+/**
+ * Narrows the window of the node at ply to (alpha, beta), as when the owner
+ * of a job has found a better move meanwhile, and passes it on down the
+ * nodes being searched below: a child's window is at most the negated
+ * window of its parent. A node whose window would close without a cutoff
+ * (a null window around an older alpha) keeps its own, and so do the nodes
+ * below it
+ */
+void search_narrow(search_thread_t *thread, int ply, int alpha, int beta) {
+	search_frame_t *frame = &thread->stack[ply];
+
+	if (alpha < frame->alpha) alpha = frame->alpha;
+	if (beta > frame->beta) beta = frame->beta;
+	if (alpha >= beta || (alpha == frame->alpha && beta == frame->beta)) return;
+	frame->alpha = alpha;
+	frame->beta = beta;
+	for (ply++; ply < MAX_PLY; ply++) {
+		search_frame_t *parent = frame;
+		int changed = 0;
+
+		frame = &thread->stack[ply];
+		if (-parent->alpha < frame->beta && -parent->alpha > frame->alpha) {
+			frame->beta = -parent->alpha;
+			changed = 1;
+		}
+		if (-parent->beta > frame->alpha && -parent->beta < frame->beta) {
+			frame->alpha = -parent->beta;
+			frame->window_alpha = frame->alpha;
+			changed = 1;
+		}
+		if (!changed) break;
+		if (frame->helpers > 0) scheduler_share_bound(thread, ply);
+	}
+}
+
+/**
+ * Searches a younger brother: thread->pos is the position after the move,
+ * one ply below the node with window (alpha, beta). A null window around
+ * alpha is tried first and only widened again if the move turns out better.
+ * Returns the score from the node's point of view
+ */
+static int search_sibling(search_thread_t *thread, int ply, int depth, int alpha, int beta) {
+	int score = -pvs(thread, ply, depth, -alpha - 1, -alpha);
+
+	if (score > alpha && score < beta && !stopped(thread, ply)) {
+		thread->stats.researches++;
+		score = -pvs(thread, ply, depth, -beta, -alpha);
+	}
+	return score;
+}
+
+/**
+ * Searches the moves of the node set up in the frame at ply, eldest brother
+ * first. Once the eldest is done the node is split: the scheduler may hand
+ * the remaining moves to idle ranks, and the node waits for them at the end.
+ * Returns the best score; meaningless if the node was stopped
+ */
+static int search_moves(search_thread_t *thread, int ply) {
+	search_frame_t *frame = &thread->stack[ply];
+	position_t *pos = &thread->pos;
+	int i, score;
+
+	while (frame->alpha < frame->beta && (i = frame->next) < frame->num_moves) {
+		int sq = frame->moves[i];
+
+		frame->next++;
+		bb_do_move(pos, sq, bb_flips(sq, pos->player, pos->opponent), &frame->undo);
+		eval_do_move(&thread->eval, sq, frame->undo.flips);
+		if (i == 0) {
+			score = -pvs(thread, ply + 1, frame->depth - 1, -frame->beta, -frame->alpha);
+		} else {
+			score = search_sibling(thread, ply + 1, frame->depth - 1, frame->alpha, frame->beta);
+		}
+		bb_undo_move(pos, &frame->undo);
+		eval_undo_move(&thread->eval, sq, frame->undo.flips);
+		/* the value of an interrupted search is meaningless, so nothing is recorded */
+		if (stopped(thread, ply + 1)) break;
+		search_record(thread, frame, i, score);
+
+		/* only the main thread talks to the other ranks */
+		if (i == 0 && thread == main_thread && scheduler_can_split(frame->depth)) {
+			frame->pos = *pos;
+			frame->split = 1;
+		}
+	}
+	frame->split = 0;
+	if (frame->helpers > 0) wait_for_helpers(thread, ply);
+	/* a cutoff that came in from another rank is dealt with now */
+	if (thread->stop_ply == ply) thread->stop_ply = MAX_PLY;
+	return frame->best_score;
+}
+
+/**
+ * Starts the move list of frame at a different move for every helper thread,
+ * so that they do not all walk the tree in the same order
+ */
+static void rotate_moves(search_frame_t *frame, int shift) {
+	int moves[MAX_MOVES];
+	int i;
+
+	shift %= frame->num_moves;
+	if (shift == 0) return;
+	for (i = 0; i < frame->num_moves; i++) moves[i] = frame->moves[(i + shift) % frame->num_moves];
+	memcpy(frame->moves, moves, frame->num_moves * sizeof(int));
+}
+
+/**
+ * Negamax alpha-beta with principal variation search: the first move gets
+ * the full window, later moves a null window around alpha that is only
+ * widened again if they turn out to be better.
+ * The position to search is thread->pos; every move is made on it in place and taken back
+ * with the undo record in this ply's frame.
+ * Returns a fail-soft score for the side to move; 0 once the search has been stopped
+ */
+int pvs(search_thread_t *thread, int ply, int depth, int alpha, int beta) {
+	search_frame_t *frame = &thread->stack[ply];
+	position_t *pos = &thread->pos;
+	tt_entry_t entry;
+	int score, hit, found, bound, empties;
+
+	/* The clock and the other ranks are only looked at every 1024 nodes; once the deadline has passed every node returns straight away.
+	 * Helper threads are stopped by the main thread */
+	if (++thread->stats.nodes >= thread->next_poll && thread == main_thread) {
+		thread->next_poll = thread->stats.nodes + 1024;
+		check_clock();
+		scheduler_poll(thread);
+	}
+	if (stopped(thread, ply)) return 0;
+
+	/* with a ply left for every empty square the game is played out to the end */
+	empties = NUM_SQUARES - bb_count(pos->player | pos->opponent);
+	if (depth >= empties) {
+		if (empties <= ENDGAME_LOCAL_EMPTIES) return endgame_solve(pos->player, pos->opponent, alpha, beta, &thread->stats);
+		score = endgame_stability_bound(pos->player, pos->opponent) * SCORE_DISC;
+		if (score <= alpha) {
+			thread->stats.stability_cutoffs++;
+			return score;
+		}
+	}
+
+	if (depth == 0 || ply >= MAX_PLY - 1) {
+		thread->stats.leaves++;
+		return eval_state_score(&thread->eval);
+	}
+
+	frame->num_moves = bb_to_list(bb_legal_moves(pos->player, pos->opponent), frame->moves);
+	if (frame->num_moves == 0) {
+		if (bb_legal_moves(pos->opponent, pos->player) == 0) return final_score(pos);
+		/* a pass does not use up depth */
+		bb_do_pass(pos, &frame->undo);
+		eval_do_move(&thread->eval, PASS, 0);
+		score = -pvs(thread, ply + 1, depth, -beta, -alpha);
+		bb_undo_move(pos, &frame->undo);
+		eval_undo_move(&thread->eval, PASS, 0);
+		return score;
+	}
+
+	hit = tt_probe(pos->key, &entry);
+	found = hit && entry.depth >= depth;
+	/* on a local miss, deep nodes ask the distributed table; only the main thread may talk to other ranks */
+	if (!found && thread == main_thread && dtt_worth(depth)) {
+		thread->stats.remote_probes++;
+		if (dtt_probe(pos->key, &entry)) {
+			hit = 1;
+			found = entry.depth >= depth;
+		}
+		if (found) {
+			thread->stats.remote_hits++;
+			tt_store(pos->key, entry.depth, entry.score, entry.bound, entry.move);
+		}
+		/* a round trip to a busy rank can take longer than the 1024 nodes between polls */
+		check_clock();
+	}
+	if (found) {
+		if (entry.bound == BOUND_EXACT
+				|| (entry.bound == BOUND_LOWER && entry.score >= beta)
+				|| (entry.bound == BOUND_UPPER && entry.score <= alpha)) {
+			thread->stats.tt_cutoffs++;
+			return entry.score;
+		}
+	}
+
+	frame->depth = depth;
+	frame->alpha = alpha;
+	frame->beta = beta;
+	frame->window_alpha = alpha;
+	frame->best_score = -SCORE_INF;
+	frame->best_move = PASS;
+	frame->next = 0;
+	frame->split = 0;
+	frame->helpers = 0;
+	/* a table entry too shallow to decide the node still knows which move was best */
+	frame->hash_move = (hit && options.ordering) ? entry.move : PASS;
+	if (options.ordering) order_moves(thread, ply);
+	if (ply == thread->root_ply && thread->id > 0) rotate_moves(frame, thread->id);
+	score = search_moves(thread, ply);
+	if (stopped(thread, ply)) return 0;
+
+	/* a score outside the window, as narrowed by the owner of a job, only bounds the true value; a game played out to the end holds at any depth */
+	bound = (score <= frame->window_alpha) ? BOUND_UPPER : (score >= frame->beta) ? BOUND_LOWER : BOUND_EXACT;
+	if (depth >= empties) depth = NUM_SQUARES;
+	tt_store(pos->key, depth, score, bound, frame->best_move);
+	if (thread == main_thread && dtt_worth(depth)) {
+		dtt_store(pos->key, depth, score, bound, frame->best_move);
+		check_clock();
+	}
+	return score;
+}
+
+/**
+ * Helper threads: wait for a position, then search it once, to the depth
+ * of the main thread's iteration or one deeper. They do not go on to later
+ * iterations of their own, so the nodes counted for an iteration are those
+ * spent on it and the effective branching factor stays meaningful
+ */
+static void *helper_main(void *arg) {
+	search_thread_t *thread = arg;
+	int generation = 0;
+	int depth;
+
+	for (;;) {
+		pthread_mutex_lock(&helper_lock);
+		while (helper_work.generation == generation) pthread_cond_wait(&helper_start, &helper_lock);
+		generation = helper_work.generation;
+		if (generation < 0) {
+			pthread_mutex_unlock(&helper_lock);
+			return NULL;
+		}
+		thread->pos = helper_work.pos;
+		eval_set(&thread->eval, &thread->pos);
+		thread->root_ply = helper_work.ply;
+		depth = helper_work.depth + (thread->id & 1);
+		pthread_mutex_unlock(&helper_lock);
+
+		if (depth <= NUM_SQUARES && !stopped(thread, thread->root_ply)) pvs(thread, thread->root_ply, depth, -SCORE_INF, SCORE_INF);
+
+		pthread_mutex_lock(&helper_lock);
+		if (--helper_work.busy == 0) pthread_cond_signal(&helper_idle);
+		pthread_mutex_unlock(&helper_lock);
+	}
+}
+
+/**
+ * Sets the helper threads searching pos, ply plies below the root, from depth plies on
+ */
+static void start_helpers(const position_t *pos, int ply, int depth) {
+	int i;
+
+	main_thread->stop_ply = MAX_PLY;
+	main_thread->root_ply = ply;
+	if (num_threads < 2) return;
+	pthread_mutex_lock(&helper_lock);
+	helper_work.pos = *pos;
+	helper_work.ply = ply;
+	helper_work.depth = depth;
+	helper_work.generation++;
+	helper_work.busy = num_threads - 1;
+	for (i = 1; i < num_threads; i++) threads[i].stop_ply = MAX_PLY;
+	pthread_cond_broadcast(&helper_start);
+	pthread_mutex_unlock(&helper_lock);
+}
+
+/**
+ * Stops the helper threads, waits for them and collects the counters of every thread
+ */
+static void stop_helpers(void) {
+	int i;
+
+	if (num_threads > 1) {
+		pthread_mutex_lock(&helper_lock);
+		for (i = 1; i < num_threads; i++) threads[i].stop_ply = -1;
+		while (helper_work.busy > 0) pthread_cond_wait(&helper_idle, &helper_lock);
+		pthread_mutex_unlock(&helper_lock);
+	}
+	collect_search_stats();
+}
+
+/**
+ * Searches the given root moves of pos to depth plies, in that order and
+ * with window (alpha, beta), with the help of the other ranks.
+ * scores receives the score of every move;
+ * later moves that did not beat the best one are only bounded from above.
+ * Returns 1 if the search completed before the deadline, 0 if it was cut off
+ */
+int search_root(const position_t *pos, const int *moves, int num_moves, int depth, int alpha, int beta, int *scores, int *best_move, int *best_score) {
+	search_thread_t *thread = main_thread;
+	search_frame_t *root = &thread->stack[0];
+	int i;
+
+	thread->pos = *pos;
+	eval_set(&thread->eval, pos);
+	root->num_moves = num_moves;
+	memcpy(root->moves, moves, num_moves * sizeof(int));
+	for (i = 0; i < num_moves; i++) root->scores[i] = -SCORE_INF;
+	root->depth = depth;
+	root->alpha = alpha;
+	root->beta = beta;
+	root->best_score = -SCORE_INF;
+	root->best_move = PASS;
+	root->hash_move = PASS;
+	root->next = 0;
+	root->split = 0;
+	root->helpers = 0;
+
+	start_helpers(pos, 0, depth);
+	search_moves(thread, 0);
+	stop_helpers();
+	memcpy(scores, root->scores, num_moves * sizeof(int));
+	*best_move = root->best_move;
+	*best_score = root->best_score;
+	return !search_aborted;
+}
+
+/**
+ * Searches a move handed out by another rank: pos is the position after the
+ * move, at ply below a node with window (alpha, beta).
+ * Returns 1 and the score from the node's point of view, or 0 if the search
+ * was stopped by the deadline or by the owner of the node
+ */
+int search_job(const position_t *pos, int ply, int depth, int alpha, int beta, int *score) {
+	search_thread_t *thread = main_thread;
+	/* the frame above stands in for the node on the owner, whose window can still narrow (search_narrow) */
+	search_frame_t *node = &thread->stack[ply - 1];
+	int completed;
+
+	node->alpha = alpha;
+	node->beta = beta;
+	node->split = 0;
+	node->helpers = 0;
+	thread->pos = *pos;
+	eval_set(&thread->eval, pos);
+	start_helpers(pos, ply, depth);
+	/* as search_sibling, but the re-search is only needed, and only made, against the window as it is by then */
+	*score = -pvs(thread, ply, depth, -alpha - 1, -alpha);
+	if (*score > node->alpha && *score < node->beta && !stopped(thread, ply)) {
+		thread->stats.researches++;
+		*score = -pvs(thread, ply, depth, -node->beta, -node->alpha);
+	}
+	completed = !stopped(thread, ply);
+	stop_helpers();
+	return completed;
+}
+
+/**
+ * Searches pos on its own with window (alpha, beta), for searches that
+ * hand out work themselves (TDS). These are small subtrees, and many of
+ * them: waking the helper threads and waiting for them would cost about
+ * as much as the search, so the main thread searches them alone.
+ * Returns 1 and the score, or 0 if the deadline passed
+ */
+int search_local(const position_t *pos, int depth, int alpha, int beta, int *score) {
+	search_thread_t *thread = main_thread;
+	int completed;
+
+	thread->pos = *pos;
+	thread->root_ply = 0;
+	thread->stop_ply = MAX_PLY;
+	eval_set(&thread->eval, pos);
+	*score = pvs(thread, 0, depth, alpha, beta);
+	completed = !stopped(thread, 0);
+	collect_search_stats();
+	return completed;
+}
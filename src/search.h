@@ -0,0 +1,91 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include "bitboard.h"
+#include "eval.h"
+
+/* Scores are disc differences from the side to move's point of view, in the evaluation's 1/SCORE_DISC of a disc */
+#define SCORE_DISC EVAL_SCALE
+#define SCORE_INF (100 * SCORE_DISC)
+#define score_in_discs(score) ((double) (score) / SCORE_DISC)
+
+/* 60 moves, with at most one pass between two of them */
+#define MAX_PLY 128
+#define MAX_MOVES NUM_SQUARES
+
+/* Counters kept by the search; all longs so they can be summed over ranks in one reduction */
+typedef struct {
+	long nodes;		/* positions visited, leaves included */
+	long leaves;		/* positions scored by the static evaluation */
+	long cutoffs;		/* nodes that failed high */
+	long first_cutoffs;	/* ... on the first move searched */
+	long hash_cutoffs;	/* ... on the move the transposition table suggested */
+	long killer_cutoffs;	/* ... on a killer move of their ply */
+	long researches;	/* null-window probes that had to be searched again with the full window */
+	long tt_cutoffs;	/* nodes answered by the transposition table */
+	long stability_cutoffs;	/* endgame nodes that could not reach alpha because of the opponent's stable discs */
+	long remote_probes;	/* probes of the distributed table */
+	long remote_hits;	/* ... that found a deep enough entry */
+	long jobs;		/* moves handed out to other ranks */
+	long aborts;		/* ... that were stopped because their node was cut off */
+	long bounds;		/* narrower windows sent to the ranks searching such moves */
+} search_stats_t;
+
+#define SEARCH_STATS_FIELDS ((int) (sizeof(search_stats_t) / sizeof(long)))
+
+/*
+ * Everything the search needs at one ply, so that nothing is allocated while searching.
+ * The window and the best score live here rather than in pvs' locals because
+ * results of moves searched on other ranks come in through the scheduler.
+ */
+typedef struct {
+	undo_t undo;			/* takes back the move made from this ply */
+	int num_moves;
+	int moves[MAX_MOVES];		/* moves in the order they are searched */
+	int hash_move;			/* best move the transposition table knows for the node, or PASS */
+	int killers[2];			/* the last two moves that cut off at this ply, newest first */
+	int scores[MAX_MOVES];		/* scores of the moves searched so far */
+	int depth;
+	int alpha;
+	int beta;
+	int window_alpha;		/* alpha the node was searched with, raised only when the owner of a job narrows its window */
+	int best_score;
+	int best_move;
+	int next;			/* index of the next move to search, here or on another rank */
+	int split;			/* the eldest move is done: the others may be handed out */
+	int helpers;			/* moves of this node being searched on other ranks */
+	position_t pos;			/* the node, kept for handing out moves once it is split */
+} search_frame_t;
+
+/* One search: a single position made and unmade in place, and a frame for every ply, allocated once at startup */
+typedef struct {
+	position_t pos;
+	eval_state_t eval;		/* evaluation features of pos, made and unmade along with it */
+	int id;				/* 0 for the main thread, which alone talks to the other ranks */
+	int root_ply;			/* ply the current search started at */
+	volatile int stop_ply;		/* plies deeper than this are being abandoned and return straight away */
+	long next_poll;			/* node count at which the main thread next looks at the clock and the other ranks */
+	search_stats_t stats;
+	int history[NUM_SQUARES];	/* how often and how deep each square has cut off, for ordering quiet moves */
+	search_frame_t stack[MAX_PLY];
+} search_thread_t;
+
+extern search_stats_t search_stats;
+extern double search_deadline;
+extern volatile int search_aborted;
+extern volatile int search_interrupted;
+
+int search_init(void);
+void search_free(void);
+void start_search_clock(double budget);
+void start_new_root(const position_t *root);
+void reset_search_stats(void);
+int search_root(const position_t *pos, const int *moves, int num_moves, int depth, int alpha, int beta, int *scores, int *best_move, int *best_score);
+int search_job(const position_t *pos, int ply, int depth, int alpha, int beta, int *score);
+int search_local(const position_t *pos, int depth, int alpha, int beta, int *score);
+void search_record(search_thread_t *thread, search_frame_t *frame, int i, int score);
+void search_narrow(search_thread_t *thread, int ply, int alpha, int beta);
+int pvs(search_thread_t *thread, int ply, int depth, int alpha, int beta);
+int final_score(const position_t *pos);
+
+#endif
@@ -0,0 +1,628 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <mpi.h>
+#include "comms.h"
+#include "bitboard.h"
+#include "hash.h"
+#include "options.h"
+#include "search.h"
+#include "tds.h"
+
+/*
+ * Transposition-driven scheduling
+ * -------------------------------
+ * Every position has an owner rank, picked from its key, and is only ever
+ * searched there, against that rank's table: instead of fetching table
+ * entries from other ranks, the work moves to the rank that has them.
+ *
+ * A search is a null-window question "is the score of this position at
+ * least gamma?" sent to the owner as a work unit. The owner answers from
+ * its table if it can, searches shallow positions itself, and otherwise
+ * expands the position into a node: the eldest move is sent out first,
+ * the others once it has come back without a cutoff. Results travel back
+ * to the owner of the node, and the node's result to whoever asked. The
+ * same question asked again while a node is open waits for that node.
+ *
+ * Units for the same rank are batched and sent with MPI_Isend; every rank
+ * keeps one MPI_Irecv posted. Rank 0 drives MTD(f) over the null-window
+ * searches. When a search is over it sends TAG_TDS_STOP, and the ranks
+ * count batches sent and received (summed with MPI_Allreduce) until every
+ * batch in flight has arrived, so each search starts with empty channels.
+ */
+
+#define UNIT_WORK 0
+#define UNIT_RESULT 1
+#define PARENT_ROOT -1		/* the parent of the root question is rank 0 itself */
+
+#define BATCH_UNITS 64
+#define INDEX_SIZE 4096		/* buckets of the index of open nodes, a power of two */
+
+/* A question or an answer; all int64 so that a batch is one MPI_INT64_T array */
+typedef struct {
+	int64_t type;
+	int64_t player;		/* position asked about */
+	int64_t opponent;
+	int64_t depth;
+	int64_t score;		/* gamma of a question, score of an answer */
+	int64_t move;		/* move the parent played, echoed in the answer */
+	int64_t best_move;	/* answer: best move of the position, if it failed high */
+	int64_t parent;		/* node index on the parent's rank, or PARENT_ROOT */
+	int64_t parent_id;
+	int64_t from;		/* the parent's rank */
+} unit_t;
+
+#define UNIT_FIELDS ((int) (sizeof(unit_t) / sizeof(int64_t)))
+
+/* Somebody waiting for the answer of an open node */
+typedef struct {
+	int rank;
+	int64_t parent;
+	int64_t parent_id;
+	int move;
+	int next;
+} waiter_t;
+
+/* A position that has been expanded here and is waiting for the answers of its moves */
+typedef struct {
+	int64_t id;		/* 0 when the slot is free */
+	position_t pos;
+	int depth;
+	int gamma;
+	int num_moves;
+	int next;		/* next move to send out */
+	int outstanding;	/* moves sent out and not answered yet */
+	int best;
+	int best_move;
+	int waiters;		/* first waiter, or -1 */
+	int chain;		/* next node in the same index bucket, or next free node */
+	int moves[MAX_MOVES];
+} tds_node_t;
+
+/* Units on their way to one rank */
+typedef struct {
+	unit_t units[BATCH_UNITS];
+	int count;
+	unit_t sending[BATCH_UNITS];	/* the batch in flight */
+	MPI_Request request;
+} outbox_t;
+
+static int num_ranks;
+static int my_rank;
+
+static tds_node_t *nodes = NULL;
+static int node_capacity = 0;
+static int free_nodes;
+static int64_t next_node_id = 1;
+static int index_heads[INDEX_SIZE];
+
+static waiter_t *waiters = NULL;
+static int waiter_capacity = 0;
+static int free_waiters;
+
+/* Units to process here, taken newest first so the search stays depth-first */
+static unit_t *queue = NULL;
+static int queued = 0;
+static int queue_capacity = 0;
+
+static outbox_t *outboxes = NULL;
+static unit_t inbox[BATCH_UNITS];
+static MPI_Request inbox_request;		/* posted for the whole of run() */
+
+static long batches_sent;
+static long batches_received;
+static int stopping;
+
+/* Answer to the root question, on rank 0 */
+static int root_answered;
+static int root_score;
+static int root_move;
+
+/**
+ * Allocates the pools. They grow when a search needs more
+ */
+int tds_init(void) {
+	int rank;
+
+	MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	node_capacity = 1024;
+	waiter_capacity = 1024;
+	queue_capacity = 4096;
+	nodes = malloc(node_capacity * sizeof(tds_node_t));
+	waiters = malloc(waiter_capacity * sizeof(waiter_t));
+	queue = malloc(queue_capacity * sizeof(unit_t));
+	outboxes = malloc(num_ranks * sizeof(outbox_t));
+	if (nodes == NULL || waiters == NULL || queue == NULL || outboxes == NULL) return FAILURE;
+	for (rank = 0; rank < num_ranks; rank++) outboxes[rank].request = MPI_REQUEST_NULL;
+	return SUCCESS;
+}
+
+void tds_free(void) {
+	free(nodes);
+	free(waiters);
+	free(queue);
+	free(outboxes);
+	nodes = NULL;
+	waiters = NULL;
+	queue = NULL;
+	outboxes = NULL;
+}
+
+/**
+ * Returns the rank that owns a position
+ */
+static int owner_of(uint64_t key) {
+	return (int) ((key >> 44) % (uint64_t) num_ranks);
+}
+
+/**
+ * Empties the pools, the index and the outboxes for a new search
+ */
+static void reset(void) {
+	int i;
+
+	for (i = 0; i < node_capacity; i++) {
+		nodes[i].id = 0;
+		nodes[i].chain = i + 1;
+	}
+	nodes[node_capacity - 1].chain = -1;
+	free_nodes = 0;
+	for (i = 0; i < waiter_capacity; i++) waiters[i].next = i + 1;
+	waiters[waiter_capacity - 1].next = -1;
+	free_waiters = 0;
+	for (i = 0; i < INDEX_SIZE; i++) index_heads[i] = -1;
+	for (i = 0; i < num_ranks; i++) outboxes[i].count = 0;
+	queued = 0;
+	batches_sent = 0;
+	batches_received = 0;
+	stopping = 0;
+	root_answered = 0;
+}
+
+/**
+ * Returns a free node, growing the pool if needed. Earlier node pointers may move
+ */
+static int alloc_node(void) {
+	int i;
+
+	if (free_nodes < 0) {
+		tds_node_t *grown = realloc(nodes, 2 * node_capacity * sizeof(tds_node_t));
+		if (grown == NULL) return -1;
+		nodes = grown;
+		for (i = node_capacity; i < 2 * node_capacity; i++) {
+			nodes[i].id = 0;
+			nodes[i].chain = i + 1;
+		}
+		nodes[2 * node_capacity - 1].chain = -1;
+		free_nodes = node_capacity;
+		node_capacity *= 2;
+	}
+	i = free_nodes;
+	free_nodes = nodes[i].chain;
+	nodes[i].id = next_node_id++;
+	return i;
+}
+
+static int alloc_waiter(void) {
+	int i;
+
+	if (free_waiters < 0) {
+		waiter_t *grown = realloc(waiters, 2 * waiter_capacity * sizeof(waiter_t));
+		if (grown == NULL) return -1;
+		waiters = grown;
+		for (i = waiter_capacity; i < 2 * waiter_capacity; i++) waiters[i].next = i + 1;
+		waiters[2 * waiter_capacity - 1].next = -1;
+		free_waiters = waiter_capacity;
+		waiter_capacity *= 2;
+	}
+	i = free_waiters;
+	free_waiters = waiters[i].next;
+	return i;
+}
+
+static void push_unit(const unit_t *unit) {
+	if (queued == queue_capacity) {
+		unit_t *grown = realloc(queue, 2 * queue_capacity * sizeof(unit_t));
+		/* out of memory: the unit is lost and so is the search, which the deadline ends */
+		if (grown == NULL) return;
+		queue = grown;
+		queue_capacity *= 2;
+	}
+	queue[queued++] = *unit;
+}
+
+/**
+ * Takes in every batch that has arrived and posts the receive again.
+ * Once the search is stopping, batches are only counted
+ */
+static void poll_inbox(void) {
+	MPI_Status status;
+	int flag, count, i;
+
+	for (;;) {
+		MPI_Test(&inbox_request, &flag, &status);
+		if (!flag) return;
+		batches_received++;
+		MPI_Get_count(&status, MPI_INT64_T, &count);
+		for (i = 0; !stopping && i < count / UNIT_FIELDS; i++) push_unit(&inbox[i]);
+		MPI_Irecv(inbox, BATCH_UNITS * UNIT_FIELDS, MPI_INT64_T, MPI_ANY_SOURCE, TAG_TDS_BATCH, MPI_COMM_WORLD, &inbox_request);
+	}
+}
+
+/**
+ * Sends the units gathered for rank. The previous batch to that rank has
+ * to be out of the way first; the inbox is kept going meanwhile so that
+ * two ranks sending to each other cannot wait on each other
+ */
+static void flush(int rank) {
+	outbox_t *box = &outboxes[rank];
+	int done = 0;
+
+	if (box->count == 0) return;
+	for (;;) {
+		MPI_Test(&box->request, &done, MPI_STATUS_IGNORE);
+		if (done) break;
+		poll_inbox();
+	}
+	memcpy(box->sending, box->units, box->count * sizeof(unit_t));
+	MPI_Isend(box->sending, box->count * UNIT_FIELDS, MPI_INT64_T, rank, TAG_TDS_BATCH, MPI_COMM_WORLD, &box->request);
+	batches_sent++;
+	box->count = 0;
+}
+
+static void flush_all(void) {
+	int rank;
+
+	for (rank = 0; rank < num_ranks; rank++) flush(rank);
+}
+
+static void send_unit(int rank, const unit_t *unit) {
+	if (rank == my_rank) {
+		push_unit(unit);
+		return;
+	}
+	outboxes[rank].units[outboxes[rank].count++] = *unit;
+	if (outboxes[rank].count == BATCH_UNITS) flush(rank);
+}
+
+/**
+ * Sends the answer to a question
+ */
+static void answer(int rank, int64_t parent, int64_t parent_id, int move, int score, int best_move) {
+	unit_t unit = {UNIT_RESULT, 0, 0, 0, score, move, best_move, parent, parent_id, rank};
+
+	send_unit(rank, &unit);
+}
+
+/**
+ * Sends the question for move i of node n to the owner of the position it leads to
+ */
+static void send_move(int n, int i) {
+	tds_node_t *node = &nodes[n];
+	position_t child = node->pos;
+	int depth = node->depth;
+	unit_t unit;
+	int rank;
+
+	if (node->moves[i] == PASS) {
+		/* a pass does not use up depth */
+		bb_pass(&child);
+	} else {
+		bb_make_move(&child, node->moves[i], bb_flips(node->moves[i], child.player, child.opponent));
+		depth--;
+	}
+	unit.type = UNIT_WORK;
+	unit.player = (int64_t) child.player;
+	unit.opponent = (int64_t) child.opponent;
+	unit.depth = depth;
+	unit.score = 1 - node->gamma;
+	unit.move = node->moves[i];
+	unit.best_move = PASS;
+	unit.parent = n;
+	unit.parent_id = node->id;
+	unit.from = my_rank;
+	node->outstanding++;
+
+	rank = owner_of(child.key);
+	if (rank != my_rank) search_stats.jobs++;
+	send_unit(rank, &unit);
+}
+
+/**
+ * Returns the open node for this question, or -1
+ */
+static int find_node(uint64_t key, int depth, int gamma) {
+	int n;
+
+	for (n = index_heads[key & (INDEX_SIZE - 1)]; n >= 0; n = nodes[n].chain) {
+		if (nodes[n].pos.key == key && nodes[n].depth == depth && nodes[n].gamma == gamma) return n;
+	}
+	return -1;
+}
+
+/**
+ * A node has its answer: stores it, tells everybody waiting and frees the node.
+ * Answers for moves still out are dropped when they come in
+ */
+static void resolve(int n) {
+	tds_node_t *node = &nodes[n];
+	int *link = &index_heads[node->pos.key & (INDEX_SIZE - 1)];
+	int w;
+
+	tt_store(node->pos.key, node->depth, node->best, (node->best >= node->gamma) ? BOUND_LOWER : BOUND_UPPER, node->best_move);
+	for (w = node->waiters; w >= 0; w = waiters[w].next) {
+		answer(waiters[w].rank, waiters[w].parent, waiters[w].parent_id, waiters[w].move, node->best, node->best_move);
+	}
+	for (w = node->waiters; w >= 0; ) {
+		int next = waiters[w].next;
+		waiters[w].next = free_waiters;
+		free_waiters = w;
+		w = next;
+	}
+
+	while (*link != n) link = &nodes[*link].chain;
+	*link = node->chain;
+	node->id = 0;
+	node->chain = free_nodes;
+	free_nodes = n;
+}
+
+/**
+ * Adds whoever asked unit's question to the waiters of node n
+ */
+static void add_waiter(int n, const unit_t *unit) {
+	int w = alloc_waiter();
+
+	if (w < 0) return;
+	waiters[w].rank = (int) unit->from;
+	waiters[w].parent = unit->parent;
+	waiters[w].parent_id = unit->parent_id;
+	waiters[w].move = (int) unit->move;
+	waiters[w].next = nodes[n].waiters;
+	nodes[n].waiters = w;
+}
+
+/**
+ * Moves sq, the best move the transposition table remembers, to the front
+ * of the node's moves so that it is the eldest brother
+ */
+static void move_to_front(tds_node_t *node, int sq) {
+	int i;
+
+	for (i = 1; i < node->num_moves; i++) {
+		if (node->moves[i] == sq) {
+			node->moves[i] = node->moves[0];
+			node->moves[0] = sq;
+			return;
+		}
+	}
+}
+
+/**
+ * Answers a question from the table, by searching it here or by opening a node for it
+ */
+static void take_question(const unit_t *unit) {
+	position_t pos;
+	tt_entry_t entry;
+	int depth = (int) unit->depth;
+	int gamma = (int) unit->score;
+	int is_root = (unit->parent == PARENT_ROOT);
+	int n, score, hit;
+
+	pos.player = (uint64_t) unit->player;
+	pos.opponent = (uint64_t) unit->opponent;
+	bb_hash_position(&pos);
+	search_stats.nodes++;
+
+	/* the root is always expanded, so that its best move comes back */
+	hit = tt_probe(pos.key, &entry);
+	if (!is_root && hit && entry.depth >= depth) {
+		if ((entry.bound != BOUND_UPPER && entry.score >= gamma) || (entry.bound != BOUND_LOWER && entry.score < gamma)) {
+			search_stats.tt_cutoffs++;
+			answer((int) unit->from, unit->parent, unit->parent_id, (int) unit->move, entry.score, entry.move);
+			return;
+		}
+	}
+	if (!is_root && depth <= options.tds_local_depth) {
+		if (search_local(&pos, depth, gamma - 1, gamma, &score)) {
+			answer((int) unit->from, unit->parent, unit->parent_id, (int) unit->move, score, PASS);
+		}
+		return;
+	}
+
+	n = find_node(pos.key, depth, gamma);
+	if (n >= 0) {
+		add_waiter(n, unit);
+		return;
+	}
+
+	n = alloc_node();
+	if (n < 0) return;
+	nodes[n].pos = pos;
+	nodes[n].depth = depth;
+	nodes[n].gamma = gamma;
+	nodes[n].next = 0;
+	nodes[n].outstanding = 0;
+	nodes[n].best = -SCORE_INF;
+	nodes[n].best_move = PASS;
+	nodes[n].waiters = -1;
+	nodes[n].num_moves = bb_to_list(bb_legal_moves(pos.player, pos.opponent), nodes[n].moves);
+	if (nodes[n].num_moves == 0) {
+		if (bb_legal_moves(pos.opponent, pos.player) == 0) {
+			nodes[n].id = 0;
+			nodes[n].chain = free_nodes;
+			free_nodes = n;
+			answer((int) unit->from, unit->parent, unit->parent_id, (int) unit->move, final_score(&pos), PASS);
+			return;
+		}
+		nodes[n].moves[0] = PASS;
+		nodes[n].num_moves = 1;
+	} else if (hit && options.ordering) {
+		move_to_front(&nodes[n], entry.move);
+	}
+	nodes[n].chain = index_heads[pos.key & (INDEX_SIZE - 1)];
+	index_heads[pos.key & (INDEX_SIZE - 1)] = n;
+	add_waiter(n, unit);
+
+	/* Young Brothers Wait: the eldest move goes out alone */
+	nodes[n].next = 1;
+	send_move(n, 0);
+}
+
+/**
+ * Takes in the answer for one move of a node
+ */
+static void take_answer(const unit_t *unit) {
+	tds_node_t *node;
+	int score = -(int) unit->score;
+
+	if (unit->parent == PARENT_ROOT) {
+		root_answered = 1;
+		root_score = (int) unit->score;
+		root_move = (int) unit->best_move;
+		return;
+	}
+	node = &nodes[unit->parent];
+	if (node->id != unit->parent_id) return;
+
+	node->outstanding--;
+	if (score > node->best) {
+		node->best = score;
+		node->best_move = (int) unit->move;
+	}
+	if (node->best >= node->gamma) {
+		search_stats.cutoffs++;
+		resolve((int) unit->parent);
+		return;
+	}
+	while (node->next < node->num_moves) send_move((int) unit->parent, node->next++);
+	if (node->outstanding == 0) resolve((int) unit->parent);
+}
+
+/**
+ * Processes units until the search is stopped, then waits for every batch in flight
+ */
+static void run(void) {
+	long counts[2], totals[2];
+	int processed = 0;
+	int flag, rank;
+
+	MPI_Irecv(inbox, BATCH_UNITS * UNIT_FIELDS, MPI_INT64_T, MPI_ANY_SOURCE, TAG_TDS_BATCH, MPI_COMM_WORLD, &inbox_request);
+	while (!stopping) {
+		poll_inbox();
+		if (queued > 0 && !search_aborted) {
+			unit_t unit = queue[--queued];
+
+			if (unit.type == UNIT_WORK) {
+				take_question(&unit);
+			} else {
+				take_answer(&unit);
+			}
+			/* do not sit on units others may be waiting for */
+			if (++processed % BATCH_UNITS == 0) flush_all();
+		} else {
+			flush_all();
+		}
+
+		if (MPI_Wtime() > search_deadline || search_interrupted) search_aborted = 1;
+		if (my_rank == 0) {
+			if (root_answered || search_aborted) {
+				for (rank = 1; rank < num_ranks; rank++) MPI_Send(NULL, 0, MPI_INT, rank, TAG_TDS_STOP, MPI_COMM_WORLD);
+				stopping = 1;
+			}
+		} else {
+			MPI_Iprobe(0, TAG_TDS_STOP, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+			if (flag) {
+				MPI_Recv(NULL, 0, MPI_INT, 0, TAG_TDS_STOP, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+				stopping = 1;
+			}
+		}
+	}
+
+	/* Termination: nothing new is sent any more, so once as many batches have arrived as were sent, none is left in flight */
+	for (;;) {
+		poll_inbox();
+		counts[0] = batches_sent;
+		counts[1] = batches_received;
+		MPI_Allreduce(counts, totals, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+		if (totals[0] == totals[1]) break;
+	}
+	for (rank = 0; rank < num_ranks; rank++) MPI_Wait(&outboxes[rank].request, MPI_STATUS_IGNORE);
+	MPI_Cancel(&inbox_request);
+	MPI_Wait(&inbox_request, MPI_STATUS_IGNORE);
+}
+
+/**
+ * Rank 0: one distributed null-window search of pos around gamma.
+ * Returns 1 and a fail-soft score (and the best move if it is >= gamma), or 0 if the deadline passed
+ */
+static int null_window_search(const position_t *pos, int depth, int gamma, int *score, int *best_move) {
+	unit_t root = {UNIT_WORK, (int64_t) pos->player, (int64_t) pos->opponent, depth, gamma, PASS, PASS, PARENT_ROOT, 0, 0};
+	int more = 1;
+
+	MPI_Bcast(&more, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	reset();
+	send_unit(owner_of(pos->key), &root);
+	run();
+	*score = root_score;
+	*best_move = root_move;
+	return root_answered;
+}
+
+/**
+ * Rank 0: searches pos to depth plies with MTD(f), starting from guess.
+ * Scores are much finer than a disc, so a guess that is off would take
+ * many searches to close in on a step at a time: every search that fails
+ * the same way as the one before steps twice as far past the bound.
+ * Returns 1 if the search completed before the deadline, 0 if it was cut off
+ */
+int tds_search_master(const position_t *pos, int depth, int guess, int *best_move, int *best_score) {
+	int lower = -SCORE_INF;
+	int upper = SCORE_INF;
+	int g = (guess > -SCORE_INF && guess < SCORE_INF) ? guess : 0;
+	int completed = 1;
+	int more = 0;
+	int step = 1, last = 0;		/* last: 1 failed high, -1 failed low */
+	int gamma, move;
+
+	*best_move = PASS;
+	while (lower < upper) {
+		if (g == lower) {
+			gamma = (upper - g > step) ? g + step : upper;
+		} else {
+			gamma = (g + 1 - lower > step) ? g + 1 - step : lower + 1;
+		}
+		if (!null_window_search(pos, depth, gamma, &g, &move)) {
+			completed = 0;
+			break;
+		}
+		if (g >= gamma) {
+			lower = g;
+			*best_move = move;
+			step = (last > 0) ? 2 * step : 1;
+			last = 1;
+		} else {
+			upper = g;
+			step = (last < 0) ? 2 * step : 1;
+			last = -1;
+		}
+	}
+	MPI_Bcast(&more, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	*best_score = g;
+	return completed;
+}
+
+/**
+ * Worker ranks: takes part in every null-window search of rank 0's current iteration
+ */
+void tds_search_worker(void) {
+	int more;
+
+	for (;;) {
+		MPI_Bcast(&more, 1, MPI_INT, 0, MPI_COMM_WORLD);
+		if (!more) return;
+		reset();
+		run();
+	}
+}
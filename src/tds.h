@@ -0,0 +1,15 @@
+#ifndef _TDS_H
+#define _TDS_H
+
+#include "bitboard.h"
+
+/* Message tags of transposition-driven scheduling, apart from those of scheduler.h */
+#define TAG_TDS_BATCH 11	/* a batch of work units and results */
+#define TAG_TDS_STOP 12		/* rank 0 -> workers: the current search is over */
+
+int tds_init(void);
+void tds_free(void);
+int tds_search_master(const position_t *pos, int depth, int guess, int *best_move, int *best_score);
+void tds_search_worker(void);
+
+#endif
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+#include "comms.h"
+#include "bitboard.h"
+#include "hash.h"
+#include "options.h"
+#include "search.h"
+#include "eval.h"
+
+/*
+ * Fits the pattern weights of eval.c to games the engine plays against
+ * itself. Every rank plays its own games: a few random moves to get away
+ * from the opening, then the move of a shallow search, until EXACT_EMPTIES
+ * squares are left, from where every position is searched to the end.
+ * Each position is labelled with the final score perfect play reaches from
+ * the first of those, or with its own exact score once there. The weights
+ * are then fitted by least squares, every rank working out the gradient
+ * over its own positions and the ranks adding them up each epoch.
+ *
+ * mpirun -np <ranks> player/trainer [games per rank] [search depth] [epochs] [weight file]
+ */
+#define RANDOM_PLIES 10		/* moves played at random at the start of every game */
+#define RANDOM_ONE_IN 16	/* later on, one move in this many is random as well */
+#define EXACT_EMPTIES 14	/* positions with this few empty squares are labelled with their exact score */
+#define COUNT_PRIOR 8		/* weights seen in few positions move more slowly */
+
+typedef struct {
+	int phase;
+	int label;		/* final disc difference for the side to move, in search units (SCORE_DISC) */
+	int features[EVAL_INSTANCES];
+} sample_t;
+
+static sample_t *samples = NULL;
+static int num_samples = 0;
+static int sample_capacity = 0;
+
+static uint64_t next_random(uint64_t *seed) {
+	/* xorshift64 */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return *seed;
+}
+
+static int add_sample(const position_t *pos, int label) {
+	if (num_samples == sample_capacity) {
+		int capacity = sample_capacity ? 2 * sample_capacity : 4096;
+		sample_t *grown = realloc(samples, capacity * sizeof(sample_t));
+
+		if (grown == NULL) return FAILURE;
+		samples = grown;
+		sample_capacity = capacity;
+	}
+	samples[num_samples].phase = eval_phase(pos);
+	samples[num_samples].label = label;
+	eval_features(pos, samples[num_samples].features);
+	num_samples++;
+	return SUCCESS;
+}
+
+/**
+ * Plays one game and adds its positions to the samples
+ */
+static int play_game(int depth, uint64_t *seed) {
+	position_t game[MAX_PLY];
+	int colours[MAX_PLY];		/* side to move of every position, 0 for the side that started */
+	int exact[MAX_PLY];		/* exact score of the positions searched to the end */
+	int moves[MAX_MOVES], scores[MAX_MOVES];
+	position_t pos;
+	int plies = 0, colour = 0, first_exact = -1;
+	int num_moves, i;
+
+	tt_clear();
+	bb_init_position(&pos);
+	for (;;) {
+		int empties = NUM_SQUARES - bb_count(pos.player | pos.opponent);
+		int move, score;
+
+		num_moves = bb_to_list(bb_legal_moves(pos.player, pos.opponent), moves);
+		if (num_moves == 0) {
+			if (bb_legal_moves(pos.opponent, pos.player) == 0) break;
+			bb_pass(&pos);
+			colour ^= 1;
+			continue;
+		}
+
+		if (empties <= EXACT_EMPTIES) {
+			/* searched to the end, which is exact */
+			start_search_clock(1e9);
+			search_root(&pos, moves, num_moves, empties, -SCORE_INF, SCORE_INF, scores, &move, &score);
+			if (first_exact < 0) first_exact = plies;
+			exact[plies] = score;
+		} else if (plies < RANDOM_PLIES || next_random(seed) % RANDOM_ONE_IN == 0) {
+			move = moves[next_random(seed) % num_moves];
+		} else {
+			start_search_clock(1e9);
+			search_root(&pos, moves, num_moves, depth, -SCORE_INF, SCORE_INF, scores, &move, &score);
+		}
+		game[plies] = pos;
+		colours[plies++] = colour;
+		bb_make_move(&pos, move, bb_flips(move, pos.player, pos.opponent));
+		colour ^= 1;
+	}
+	if (first_exact < 0) return SUCCESS;
+
+	for (i = 0; i < plies; i++) {
+		int label = (i < first_exact) ? exact[first_exact] : exact[i];
+
+		/* the score of the first exact position is for its side to move */
+		if (i < first_exact && colours[i] != colours[first_exact]) label = -label;
+		if (add_sample(&game[i], label) == FAILURE) return FAILURE;
+	}
+	return SUCCESS;
+}
+
+/**
+ * Least squares fit of the weights, starting from the ones in use.
+ * Collective; every rank ends up with the same weights
+ */
+static int fit(int16_t *fitted, int epochs) {
+	long size = (long) EVAL_PHASES * eval_table_size;
+	const int16_t *start = eval_weights();
+	float *weights = malloc(size * sizeof(float));
+	float *gradient = malloc(size * sizeof(float));
+	int *counts = calloc(size, sizeof(int));
+	long total_samples = num_samples;
+	int rank, epoch, i, j;
+
+	if (weights == NULL || gradient == NULL || counts == NULL) {
+		free(weights);
+		free(gradient);
+		free(counts);
+		return FAILURE;
+	}
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	for (j = 0; j < size; j++) weights[j] = start[j];
+	for (i = 0; i < num_samples; i++) {
+		int *features = samples[i].features;
+		long base = (long) samples[i].phase * eval_table_size;
+
+		for (j = 0; j < EVAL_INSTANCES; j++) counts[base + features[j]]++;
+	}
+	MPI_Allreduce(MPI_IN_PLACE, counts, size, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+	MPI_Allreduce(MPI_IN_PLACE, &total_samples, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+	for (epoch = 1; epoch <= epochs; epoch++) {
+		double squared_error = 0;
+
+		memset(gradient, 0, size * sizeof(float));
+		for (i = 0; i < num_samples; i++) {
+			int *features = samples[i].features;
+			long base = (long) samples[i].phase * eval_table_size;
+			float error = -(float) samples[i].label * EVAL_SCALE / SCORE_DISC;
+
+			for (j = 0; j < EVAL_INSTANCES; j++) error += weights[base + features[j]];
+			squared_error += (double) error * error;
+			for (j = 0; j < EVAL_INSTANCES; j++) gradient[base + features[j]] += error;
+		}
+		MPI_Allreduce(MPI_IN_PLACE, gradient, size, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+		MPI_Allreduce(MPI_IN_PLACE, &squared_error, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+		/* a sample whose weights appear nowhere else would be fitted exactly in one step */
+		for (j = 0; j < size; j++) {
+			if (counts[j] > 0) weights[j] -= gradient[j] / (EVAL_INSTANCES * (float) (counts[j] + COUNT_PRIOR));
+		}
+		if (rank == 0 && (epoch == 1 || epoch % 10 == 0 || epoch == epochs)) {
+			printf("epoch %d: rms error %.2f discs\n", epoch, total_samples > 0 ? sqrt(squared_error / total_samples) / EVAL_SCALE : 0.0);
+			fflush(stdout);
+		}
+	}
+
+	for (j = 0; j < size; j++) {
+		float w = weights[j] + (weights[j] >= 0 ? 0.5f : -0.5f);
+		fitted[j] = (int16_t) (w > 32767 ? 32767 : w < -32767 ? -32767 : w);
+	}
+	free(weights);
+	free(gradient);
+	free(counts);
+	return SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+	int rank, comm_sz, games, depth, epochs, game;
+	long total_samples;
+	const char *path;
+	uint64_t seed;
+	int16_t *fitted;
+	double start;
+
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+
+	options_load();
+	options.threads = 1;
+	games = (argc >= 2) ? atoi(argv[1]) : 200;
+	depth = (argc >= 3) ? atoi(argv[2]) : 4;
+	epochs = (argc >= 4) ? atoi(argv[3]) : 100;
+	path = (argc >= 5) ? argv[4] : options.weights;
+	if (games < 1 || depth < 1 || epochs < 1) {
+		if (rank == 0) fprintf(stderr, "Arguments: [games per rank] [search depth] [epochs] [weight file]\n");
+		MPI_Finalize();
+		return 1;
+	}
+
+	bb_init_kernels();
+	bb_init_zobrist();
+	if (tt_init(options.hash_mb) == FAILURE || search_init() == FAILURE || eval_init(options.weights) == FAILURE) {
+		fprintf(stderr, "Could not allocate the tables\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (rank == 0) {
+		printf("%d ranks x %d games, search depth %d, starting from %s weights\n", comm_sz, games, depth,
+			eval_weights_loaded ? options.weights : "the built-in");
+		fflush(stdout);
+	}
+
+	start = MPI_Wtime();
+	seed = 0x747261696E6572ULL + 0x9E3779B97F4A7C15ULL * (uint64_t) (rank + 1);
+	for (game = 0; game < games; game++) {
+		if (play_game(depth, &seed) == FAILURE) {
+			fprintf(stderr, "Out of memory for the positions\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+	}
+	total_samples = num_samples;
+	MPI_Allreduce(MPI_IN_PLACE, &total_samples, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+	if (rank == 0) {
+		printf("%ld positions from %d games in %.1f s\n", total_samples, comm_sz * games, MPI_Wtime() - start);
+		fflush(stdout);
+	}
+
+	fitted = malloc((size_t) EVAL_PHASES * eval_table_size * sizeof(int16_t));
+	if (fitted == NULL || fit(fitted, epochs) == FAILURE) {
+		fprintf(stderr, "Out of memory for the fit\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (rank == 0) {
+		if (eval_save(path, fitted) == SUCCESS) {
+			printf("weights written to %s\n", path);
+		} else {
+			fprintf(stderr, "Could not write %s\n", path);
+		}
+	}
+
+	free(fitted);
+	free(samples);
+	search_free();
+	tt_free();
+	eval_free();
+	MPI_Finalize();
+	return 0;
+}